@@ -0,0 +1,61 @@
+/* This file is part of 3hs
+ * Copyright (C) 2021-2022 hShop developer team
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef inc_content_hh
+#define inc_content_hh
+
+/* this header doesn't depend on libctru so tests/ can build it on the host */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/* memory a cia is downloaded to if it isn't installed, allocated once up front */
+typedef struct content_type
+{
+	uint8_t *data = nullptr;
+	uint32_t size = 0;
+	uint32_t capacity = 0;
+	~content_type() { free(this->data); }
+
+	/* makes sure there is room for size bytes, this is the only time it's allocated normally */
+	bool reserve(uint32_t size)
+	{
+		uint8_t *ndata;
+		if(size <= this->capacity)
+			return true;
+		if(!(ndata = (uint8_t *) realloc(this->data, size)))
+			return false;
+		this->data = ndata;
+		this->capacity = size;
+		return true;
+	}
+
+	/* appends len bytes of buf, if it doesn't fit it grows to at least expected bytes */
+	bool append(const uint8_t *buf, uint32_t len, uint32_t expected)
+	{
+		/* only happens if the size wasn't known in advance or the server disagrees */
+		if(this->size + len > this->capacity && !this->reserve(expected > this->size + len ? expected : this->size + len))
+			return false;
+		memcpy(this->data + this->size, buf, len);
+		this->size += len;
+		return true;
+	}
+} content_type;
+
+#endif
+
@@ -34,6 +34,7 @@
 #define APPERR_TITLE_UNLISTED MAKERESULT(RL_PERMANENT, RS_INVALIDSTATE, RM_APPLICATION, 12)
 #define APPERR_OUT_OF_MEM MAKERESULT(RL_TEMPORARY, RS_OUTOFRESOURCE, RM_APPLICATION, 13)
 #define APPERR_INCOMPATIBLE_FONT MAKERESULT(RL_PERMANENT, RS_INVALIDSTATE, RM_APPLICATION, 14)
+#define APPERR_SPOOL_FAIL MAKERESULT(RL_PERMANENT, RS_INTERNAL, RM_APPLICATION, 15)
 
 #ifdef __cplusplus
 #include <string>
@@ -31,7 +31,13 @@ namespace hlink
 	constexpr int poll_timeout_body = 1000;
 	constexpr int max_timeouts = 3;
 	constexpr int port = 37283;
-	constexpr int backlog = 2;
+	constexpr int backlog = 8;
+	constexpr size_t max_connections = 16; /* connections still sending their request */
+	constexpr size_t max_handlers = 4; /* requests handled at once */
+	constexpr int poll_timeout_busy = 10; /* handlers may give back connections */
+	constexpr int keepalive_timeout = 5000; /* idle persistent connections are closed after this */
+	constexpr size_t max_skipped_body = 0x10000; /* larger bodies close the connection */
+	constexpr size_t max_body = 0x10000; /* larger hLink transaction bodies are refused */
 
 	enum class action : uint8_t
 	{
@@ -22,14 +22,40 @@
 #include <arpa/inet.h>
 
 #include <unordered_map>
+#include <memory>
 #include <string>
 
+#include <stdio.h>
+
 
 namespace hlink
 {
 	using HTTPParameters = std::unordered_map<std::string, std::string>;
 	using HTTPHeaders    = std::unordered_map<std::string, std::string>;
 
+	/* a file under the server root, indexed when the server is created */
+	typedef struct static_file
+	{
+		std::string etag;
+		size_t size;
+		bool gzipped; /* path + ".gz" is in the table too */
+	} static_file;
+
+	typedef struct file_cache_stats
+	{
+		size_t hits;
+		size_t misses;
+		size_t evictions;
+		size_t entries;
+		size_t size; /* bytes */
+		size_t max; /* bytes */
+	} file_cache_stats;
+
+	/* has to be called once before any server is made */
+	void init_file_cache();
+	/* statistics of the cache read_path_content() uses */
+	file_cache_stats get_file_cache_stats();
+
 	class HTTPServer; /* forward decl */
 	struct HTTPRequestContext
 	{
@@ -41,6 +67,8 @@ namespace hlink
 		std::string path;
 		char buf[4096];
 		size_t buflen;
+		size_t skip; /* bytes of the previous request body that still have to be received and dropped */
+		bool keepalive; /* the connection stays open after the response */
 		bool iseof;
 		int fd;
 
@@ -50,6 +78,7 @@ namespace hlink
 		};
 
 		inline bool is_get() { return this->method == "get"; }
+		inline bool is_head() { return this->method == "head"; }
 		void serve_file(int status, const std::string& fname, HTTPHeaders headers);
 		void serve_path(int status, const std::string& path, HTTPHeaders headers);
 		void respond(int status, const std::string& data, HTTPHeaders headers);
@@ -58,24 +87,42 @@ namespace hlink
 		void redirect(const std::string& location);
 		void send_chunk(const std::string& data);
 		void send(const std::string& data);
+		/* sends all of data, returns false if the client went away */
+		bool send(const char *data, size_t len);
 		void serve_plain();
 		serve_type type(); /* NOTE: Sets this->path on success */
 		void close();
+		/* clears the request and makes feed_reqctx() drop the rest of its body,
+		 * returns false if the connection can't be used for another request */
+		bool next_request();
 
-		void read_path_content(std::string& buf);
+		/* the returned buffer is shared with the cache and must not be modified */
+		std::shared_ptr<const std::string> read_path_content();
 
 		void serve_400();
 		void serve_403();
 		void serve_404(const std::string& fname);
 		void serve_404();
 		void serve_500();
+
+	private:
+		/* the status line and headers of a response */
+		std::string head(int status, const HTTPHeaders& headers);
+		void serve_static(const static_file& file, const std::string& fname, HTTPHeaders headers);
+		bool send_file(FILE *f, size_t offset, size_t len);
 	};
 
 	class HTTPServer
 	{
 	public:
-		/* finds a new fd to make a context with */
+		/* finds a new fd to make a context with, the request is read with feed_reqctx() */
 		int make_reqctx(HTTPRequestContext& ctx);
+		/* reads what is available on the context without blocking if it was polled,
+		 * returns 1 if the request head isn't complete yet, 0 once it is parsed and -1
+		 * if the context was closed because of an error */
+		int feed_reqctx(HTTPRequestContext& ctx);
+		/* like feed_reqctx() but only looks at what is already buffered, used for pipelined requests */
+		int take_reqctx(HTTPRequestContext& ctx);
 		int make_fd();
 
 		void close();
@@ -88,8 +135,11 @@ namespace hlink
 
 
 	private:
+		std::unordered_map<std::string, static_file> files; /* read only once created */
 		std::string root;
 
+		void index_files(const std::string& dir);
+
 
 	};
 }
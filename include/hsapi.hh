@@ -18,8 +18,12 @@
 #define inc_hsapi_hh
 
 #include <unordered_map>
+#include <functional>
+#include <utility>
+#include <memory>
 #include <string>
 #include <vector>
+#include <tuple>
 
 #include <3ds.h>
 
@@ -69,6 +73,38 @@ namespace hsapi
 		constexpr int mask  = 7;
 	}
 
+	/* category and subcategory names of titles are interned: there are only a few of
+	 * them so each is stored once and titles only hold a pointer to it, which also
+	 * makes comparing two of them a pointer compare */
+	class hcat
+	{
+	public:
+		hcat() : name(&empty_name()) { }
+		hcat(const std::string& name) : name(intern(name)) { }
+		hcat(const char *name) : name(intern(name)) { }
+
+		operator const std::string& () const { return *this->name; }
+		const std::string& str() const { return *this->name; }
+		const char *c_str() const { return this->name->c_str(); }
+		size_t size() const { return this->name->size(); }
+
+		friend bool operator == (const hcat& lhs, const hcat& rhs) { return lhs.name == rhs.name; }
+		friend bool operator != (const hcat& lhs, const hcat& rhs) { return lhs.name != rhs.name; }
+		friend bool operator == (const hcat& lhs, const std::string& rhs) { return *lhs.name == rhs; }
+		friend bool operator != (const hcat& lhs, const std::string& rhs) { return *lhs.name != rhs; }
+		friend bool operator == (const hcat& lhs, const char *rhs) { return *lhs.name == rhs; }
+		friend bool operator != (const hcat& lhs, const char *rhs) { return *lhs.name != rhs; }
+
+
+	private:
+		static const std::string *intern(const std::string& name);
+		static const std::string& empty_name();
+
+		const std::string *name;
+
+
+	};
+
 	namespace impl
 	{
 		typedef struct BaseCategory
@@ -83,7 +119,7 @@ namespace hsapi
 
 	typedef struct Subcategory : public impl::BaseCategory
 	{
-		std::string cat; /* parent category */
+		hcat cat; /* parent category */
 	} Subcategory;
 
 	typedef struct Category : public impl::BaseCategory
@@ -110,10 +146,10 @@ namespace hsapi
 
 	typedef struct Title
 	{
-		std::string subcat; /* subcategory this title belongs to */
+		hcat subcat; /* subcategory this title belongs to */
 		std::string name; /* name of the title on hShop */
 		std::string alt; /* "" if none */
-		std::string cat; /* category this title belongs to */
+		hcat cat; /* category this title belongs to */
 		hsize dlCount; /* amount of title downloads */
 		hflags flags; /* title flags */
 		hsize size; /* filesize */
@@ -149,13 +185,20 @@ namespace hsapi
 
 	Result get_by_title_id(std::vector<Title>& ret, const std::string& title_id);
 	Result titles_in(std::vector<Title>& ret, const std::string& cat, const std::string& scat);
+	/* starts fetching titles_in() of scats in the background, in that order, replacing earlier requests */
+	void prefetch_titles_in(const std::string& cat, const std::vector<std::string>& scats);
 	Result batch_related(BatchRelated& ret, const std::vector<htid>& tids);
+	/* prog(done, total) is called on the calling thread as title ids are done */
+	Result batch_related(BatchRelated& ret, const std::vector<htid>& tids, std::function<void(size_t, size_t)> prog);
 	Result upload_log(const char *contents, u32 size, std::string& logid);
 	Result search(std::vector<Title>& ret, const std::unordered_map<std::string, std::string>& params);
 	Result get_download_link(std::string& ret, const Title& title);
 	Result get_theme_preview_png(std::string& ret, hid id);
 	Result get_latest_version_string(std::string& ret);
 	Result title_meta(FullTitle& ret, hid id);
+	/* fetches many titles at once, they're only cancelled through *cancel if it's set. without
+	 * it a batch started on the ui thread shows a spinner and is cancelled with B */
+	Result title_meta_batch(std::vector<FullTitle>& ret, const std::vector<hid>& ids, volatile bool *cancel = nullptr);
 	Result random(FullTitle& ret);
 	Result fetch_index();
 
@@ -177,6 +220,66 @@ namespace hsapi
 		return res;
 	}
 
+	namespace detail
+	{
+		typedef struct async_state async_state;
+		std::shared_ptr<async_state> async_submit(std::function<Result()> func);
+
+		template <typename ... Ts, size_t ... I>
+		Result async_apply(Result (*func)(Ts...), std::tuple<Ts...>& args, std::index_sequence<I...>)
+		{ return (*func)(std::get<I>(args)...); }
+	}
+
+	/* requests made on the calling thread while this is alive never read input, so they
+	 * can't be cancelled with B and don't run the SELECT menu. they are only cancelled once
+	 * *cancel becomes true. every thread other than the ui thread should use one */
+	class background_scope
+	{
+	public:
+		background_scope(volatile bool *cancel = nullptr);
+		~background_scope();
+
+
+	private:
+		volatile bool *prevCancel;
+		bool prevBackground;
+
+
+	};
+
+	/* handle to a request made with async_call() */
+	class pending
+	{
+	public:
+		pending(std::shared_ptr<detail::async_state> state) : state(state) { }
+
+		/* returns if the request finished, never blocks */
+		bool done();
+		/* waits for the request to finish and returns its result */
+		Result wait();
+		/* drops the request if it didn't start yet and stops receiving if it did,
+		 * it then finishes with APPERR_CANCELLED */
+		void cancel();
+
+
+	private:
+		std::shared_ptr<detail::async_state> state;
+
+
+	};
+
+	/* runs func(args...) on one of the persistent api threads. arguments that are
+	 * references must stay alive until the request is done, others are copied
+	 * NOTE: You have to std::move() primitives (hid, hiver, htid, ...) */
+	template <typename ... Ts>
+	pending async_call(Result (*func)(Ts...), Ts&& ... args)
+	{
+		std::shared_ptr<std::tuple<Ts...>> targs = std::make_shared<std::tuple<Ts...>>(args...);
+		return pending(detail::async_submit([func, targs]() -> Result {
+			return detail::async_apply(func, *targs, std::index_sequence_for<Ts...>());
+		}));
+	}
+
 	// NOTE: You have to std::move() primitives (hid, hiver, htid, ...)
 	template <typename ... Ts>
 	Result call(Result (*func)(Ts...), Ts&& ... args)
@@ -185,9 +288,14 @@ namespace hsapi
 		bool focus = set_focus(false);
 		Result res;
 		do {
-			ui::loading([&res, func, &args...]() -> void {
-				res = (*func)(args...);
+			/* the request runs on an api thread, so the spinner can use this one */
+			pending req = async_call(func, std::forward<Ts>(args)...);
+			ui::loading_until([&req]() -> bool {
+				/* the api thread doesn't read input, loading_until() scanned it on this thread */
+				if(hidKeysHeld() & (KEY_B | KEY_START)) req.cancel();
+				return req.done();
 			});
+			res = req.wait();
 
 			if(R_FAILED(res)) // Ask if we want to retry
 			{
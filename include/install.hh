@@ -53,6 +53,7 @@ static inline Result httpcSetProxy(httpcContext *context, u16 port,
 }
 
 Result install_forwarder(u8 *data, size_t len);
+Result install_forwarder(const char *path);
 
 namespace install
 {
@@ -60,6 +61,12 @@ namespace install
 		bool reinstallable = false);
 	Result hs_cia(const hsapi::FullTitle& meta, prog_func prog = default_prog_func,
 		bool reinstallable = false);
+
+	/* sets the title hs_cia() will most likely be called with next, its start is
+	 * fetched while the current title is finished up. nullptr if there is none */
+	void set_lookahead(const hsapi::FullTitle *next);
+	/* drops whatever set_lookahead() fetched */
+	void drop_lookahead();
 }
 
 #endif
@@ -0,0 +1,49 @@
+/* This file is part of 3hs
+ * Copyright (C) 2021-2022 hShop developer team
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef inc_netcache_hh
+#define inc_netcache_hh
+
+#include <string>
+#include <3ds.h>
+
+
+/* persistent cache of API responses, keyed by url */
+namespace netcache
+{
+	typedef struct entry
+	{
+		std::string body;
+		// Validators the server sent, empty if it didn't
+		std::string etag;
+		std::string lastmod;
+		// osGetTime() at which the server last confirmed body
+		u64 fetched = 0;
+	} entry;
+
+	/* has to be called before anything else */
+	void init();
+	/* returns false if url isn't cached */
+	bool lookup(const std::string& url, entry& ent);
+	/* stores or replaces url, evicts the least recently used entries if the cache grows too large */
+	void store(const std::string& url, entry& ent);
+	/* marks the entry of url as confirmed by the server just now */
+	void revalidated(const std::string& url, entry& ent);
+	/* returns true if ent is recent enough to be used without asking the server */
+	bool fresh(const entry& ent);
+}
+
+#endif
@@ -26,6 +26,7 @@ std::vector<hsapi::FullTitle>& queue_get();
 
 void queue_add(hsapi::hid id, bool disp = true);
 void queue_add(const hsapi::FullTitle& meta);
+void queue_add(const std::vector<hsapi::hid>& ids);
 void queue_process(size_t index);
 void queue_remove(size_t index);
 void queue_add(hsapi::hid id);
@@ -0,0 +1,64 @@
+/* This file is part of 3hs
+ * Copyright (C) 2021-2022 hShop developer team
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef inc_range_hh
+#define inc_range_hh
+
+/* this header doesn't depend on libctru so tests/ can build it on the host */
+
+#include <stdint.h>
+#include <string>
+
+
+namespace range
+{
+	/* value of the Range header for size bytes starting at from, or
+	 * everything starting at from if size is 0 */
+	static inline std::string header(uint32_t from, uint32_t size)
+	{
+		std::string ret = "bytes=" + std::to_string(from) + "-";
+		if(size != 0) ret += std::to_string(from + size - 1);
+		return ret;
+	}
+
+	/* size of the block starting at next, at most chunk bytes and never past total */
+	static inline uint32_t block(uint32_t total, uint32_t next, uint32_t chunk)
+	{
+		if(next >= total) return 0;
+		return total - next < chunk ? total - next : chunk;
+	}
+
+	/* what the answer to the first ranged request of a download starting at from means */
+	enum class reply
+	{
+		ranged,  /* the server does ranges, the rest can be requested in blocks */
+		whole,   /* the server ignored the range but the response is everything we want anyway */
+		restart, /* the server ignored the range, the download has to start over */
+		norange, /* the response is of no use */
+	};
+
+	/* restartable tells if it's fine to throw away what we have before from */
+	static inline reply classify(uint32_t status, uint32_t from, bool restartable)
+	{
+		if(status == 206) return reply::ranged;
+		if(status != 200) return reply::norange;
+		if(from == 0) return reply::whole;
+		return restartable ? reply::restart : reply::norange;
+	}
+}
+
+#endif
+
@@ -0,0 +1,184 @@
+/* This file is part of 3hs
+ * Copyright (C) 2021-2022 hShop developer team
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef inc_ring_hh
+#define inc_ring_hh
+
+/* this header only needs the parts of libctru tests/shim/3ds.h has, so tests/ can build it on the host */
+
+#include <3ds.h>
+#include "log.hh"
+
+/* amount of buffers the network threads may fill ahead of the writer thread */
+#define RING_SIZE 4
+
+
+namespace ring
+{
+	/* buffers are taken from the free slots by the network threads and handed to the writer thread
+	 * in the order they were submitted in, which may differ from the order of their offsets if
+	 * multiple connections are used. a buffer with a size of 0 is a flush, see ring::flush().
+	 * the functions taking an owner expect it to have this as `ring' and the u32s `index', which
+	 * is where the writer thread is at, and `received', which is how much was submitted */
+	typedef struct buffer_ring
+	{
+		u8 *buffers[RING_SIZE];
+		u32 sizes[RING_SIZE];
+		// Offset in the cia the buffer was received at
+		u32 offsets[RING_SIZE];
+		// Size of every buffer, the maximum chunk size
+		u32 bufsize = 0;
+		// Slots that are free and slots that are submitted to the writer thread
+		u32 freeslots[RING_SIZE], queue[RING_SIZE];
+		u32 nfree = 0, head = 0, tail = 0;
+		// Protects the slot lists, they may be accessed by multiple network threads
+		LightLock lock;
+		// Amount of buffers that are free/filled
+		LightSemaphore free, filled;
+		// Signalled every time the writer thread finished a buffer
+		LightEvent drained;
+		// Amount of flushes the writer thread handled
+		u32 flushes = 0;
+		// Set to stop the writer thread at the next flush
+		bool stop = false;
+		// Result of the writer thread, on failure all further buffers are discarded
+		Result res = 0;
+	} buffer_ring;
+
+	/* marks every buffer as free, they have to be allocated already */
+	static inline void init(buffer_ring& ring)
+	{
+		LightLock_Init(&ring.lock);
+		LightSemaphore_Init(&ring.free, RING_SIZE, RING_SIZE);
+		LightSemaphore_Init(&ring.filled, 0, RING_SIZE);
+		LightEvent_Init(&ring.drained, RESET_ONESHOT);
+		for(ring.nfree = 0; ring.nfree < RING_SIZE; ++ring.nfree)
+			ring.freeslots[ring.nfree] = ring.nfree;
+	}
+
+	/* returns a free slot, blocks until there is one */
+	static inline u32 acquire(buffer_ring& ring)
+	{
+		u32 slot;
+		LightSemaphore_Acquire(&ring.free, 1);
+		LightLock_Lock(&ring.lock);
+		slot = ring.freeslots[--ring.nfree];
+		LightLock_Unlock(&ring.lock);
+		return slot;
+	}
+
+	/* gives back a slot without submitting it */
+	static inline void release(buffer_ring& ring, u32 slot)
+	{
+		LightLock_Lock(&ring.lock);
+		ring.freeslots[ring.nfree++] = slot;
+		LightLock_Unlock(&ring.lock);
+		LightSemaphore_Release(&ring.free, 1);
+	}
+
+	/* hands the buffer of slot, received at offset, to the writer thread */
+	template <typename T>
+	void submit(T& owner, u32 slot, u32 offset, u32 size)
+	{
+		buffer_ring& ring = owner.ring;
+		ring.offsets[slot] = offset;
+		ring.sizes[slot] = size;
+		LightLock_Lock(&ring.lock);
+		ring.queue[ring.head] = slot;
+		ring.head = (ring.head + 1) % RING_SIZE;
+		owner.received += size;
+		LightLock_Unlock(&ring.lock);
+		LightSemaphore_Release(&ring.filled, 1);
+	}
+
+	/* the writer thread, write(slot) is called for every buffer in the order of their offsets
+	 * and has to advance owner.index or set ring.res. returns once it flushed with ring.stop set */
+	template <typename T, typename W>
+	void writer(T& owner, W write)
+	{
+		buffer_ring& ring = owner.ring;
+		/* buffers that were received ahead of owner.index */
+		u32 held[RING_SIZE], nheld = 0;
+		u32 slot, i;
+
+		for(;;)
+		{
+			LightSemaphore_Acquire(&ring.filled, 1);
+			LightLock_Lock(&ring.lock);
+			slot = ring.queue[ring.tail];
+			ring.tail = (ring.tail + 1) % RING_SIZE;
+			LightLock_Unlock(&ring.lock);
+
+			if(ring.sizes[slot] == 0)
+			{
+				/* nothing is in flight anymore, so whatever we hold can't become contiguous */
+				if(nheld != 0) dlog("discarding %lu out of order buffers", nheld);
+				while(nheld != 0)
+					release(ring, held[--nheld]);
+				release(ring, slot);
+				++ring.flushes;
+				LightEvent_Signal(&ring.drained);
+				if(ring.stop) break;
+				continue;
+			}
+
+			/* write everything that continues where we are */
+			held[nheld++] = slot;
+			for(i = 0; i < nheld; )
+			{
+				slot = held[i];
+				if(R_SUCCEEDED(ring.res) && ring.offsets[slot] != owner.index)
+				{
+					++i;
+					continue;
+				}
+				held[i] = held[--nheld];
+				if(R_SUCCEEDED(ring.res))
+					write(slot);
+				release(ring, slot);
+				i = 0;
+			}
+
+			LightEvent_Signal(&ring.drained);
+		}
+	}
+
+	/* waits until the writer thread wrote everything that was received */
+	template <typename T>
+	Result drain(T& owner)
+	{
+		while(owner.index != owner.received && R_SUCCEEDED(owner.ring.res))
+			LightEvent_Wait(&owner.ring.drained);
+		return owner.ring.res;
+	}
+
+	/* waits until the writer thread handled everything that was submitted,
+	 * buffers that are not contiguous with what was written are dropped.
+	 * may only be called if no other thread is submitting buffers */
+	template <typename T>
+	void flush(T& owner)
+	{
+		buffer_ring& ring = owner.ring;
+		u32 flushes = ring.flushes;
+		submit(owner, acquire(ring), 0, 0);
+		while(ring.flushes == flushes)
+			LightEvent_Wait(&ring.drained);
+		owner.received = owner.index;
+	}
+}
+
+#endif
+
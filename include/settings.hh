@@ -74,6 +74,8 @@ enum NewSettings_flags0 {
 	FLAG0_SHOW_ALT          = 0x20000,
 	FLAG0_DISABLE_GRAPH     = 0x40000,
 	FLAG0_GOTO_REGION       = 0x80000,
+	FLAG0_PARALLEL_DOWNLOADS = 0x100000,
+	FLAG0_SPOOL_DOWNLOADS   = 0x200000,
 };
 
 #define ISET_RESUME_DOWNLOADS (get_nsettings()->flags0 & FLAG0_RESUME_DOWNLOADS)
@@ -92,6 +94,8 @@ enum NewSettings_flags0 {
 #define ISET_SHOW_ALT (get_nsettings()->flags0 & FLAG0_SHOW_ALT)
 #define ISET_DISABLE_GRAPH (get_nsettings()->flags0 & FLAG0_DISABLE_GRAPH)
 #define ISET_GOTO_REGION (get_nsettings()->flags0 & FLAG0_GOTO_REGION)
+#define ISET_PARALLEL_DOWNLOADS (get_nsettings()->flags0 & FLAG0_PARALLEL_DOWNLOADS)
+#define ISET_SPOOL_DOWNLOADS (get_nsettings()->flags0 & FLAG0_SPOOL_DOWNLOADS)
 
 
 void reset_settings(bool set_default_lang = false);
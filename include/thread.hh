@@ -18,107 +18,119 @@
 #define inc_thread_hh
 
 #include <functional>
+#include <memory>
+#include <vector>
 #include <3ds.h>
 #include "panic.hh"
 
 
+#ifndef POOL_MAX_THREADS
+	/* waiting on a task that hasn't started runs it on the waiting thread, so this only
+	 * limits how much runs at once. blocking tasks aren't held to it, see ctr::pool::run() */
+	#define POOL_MAX_THREADS 16
+#endif
+
+
 namespace ctr
 {
-	template <typename ... Ts>
-	class thread
+	namespace detail
+	{
+		typedef struct task_state task_state;
+	}
+
+	/* handle to a function running on a ctr::pool */
+	class task
 	{
 	public:
-		/* exit the current thread */
-		static void exit()
-		{
-			threadExit(0);
-		}
+		task() = default;
+		task(std::shared_ptr<detail::task_state> state) : state(state) { }
 
-		/* create a new thread */
-		thread(std::function<void(Ts...)> cb, int prioAddition, Ts& ... args)
-		{
-			ThreadFuncParams *params = new ThreadFuncParams;
-			params->func = [&]() -> void { cb(args...); };
-			params->self = this;
+		/* wait for the task to finish, returns immediately for an empty handle.
+		 * if no thread of the pool started the task yet it's run on the calling thread,
+		 * so on its stack and at its priority instead of the ones the pool would use */
+		void join();
+		/* returns if the task is done */
+		bool finished();
 
-			s32 prio = 0;
-			svcGetThreadPriority(&prio, CUR_THREAD_HANDLE);
 
-			this->isFinished = false;
-			this->threadobj = threadCreate(&thread::_entrypoint, params, 64 * 1024, prio + prioAddition,
-				-2, false);
-			panic_assert(this->threadobj != nullptr, "failed to create thread");
-		}
+	private:
+		std::shared_ptr<detail::task_state> state;
 
-		~thread()
-		{
-			this->join();
-			threadFree(this->threadobj);
-		}
 
-		/* wait for the thread to finish */
-		void join()
-		{
-			if(!this->finished())
-				threadJoin(this->threadobj, U64_MAX);
-		}
+	};
 
-		/* returns if the thread is done */
-		bool finished()
-		{
-			return this->isFinished;
-		}
+	/* long lived threads that run submitted functions, so a thread doesn't have to be
+	 * created for every bit of work. threads are only created when no thread is idle
+	 * and stay around until the pool is destroyed */
+	class pool
+	{
+	public:
+		/* core is passed to threadCreate(), -2 for the default core of the application */
+		pool(int core = -2, size_t max = POOL_MAX_THREADS);
+		~pool();
+
+		/* runs cb on one of the threads at the priority of the calling thread plus prioAddition,
+		 * tasks with a higher priority are picked first. a blocking task waits for something other
+		 * tasks do, like signalling an event, so it can't wait in the queue until a thread is free
+		 * while those are running, a thread is made for it even if the pool has max threads already */
+		task run(std::function<void()> cb, int prioAddition = 0, bool blocking = false);
+
+		/* the pool ctr::thread uses */
+		static pool& global();
+		/* a pool for work that isn't latency sensitive, runs on the extra core of the New 3DS if possible */
+		static pool& background();
 
 
 	private:
-		typedef struct ThreadFuncParams
-		{
-			std::function<void()> func;
-			thread *self;
-		} ThreadFuncParams;
+		std::vector<std::shared_ptr<detail::task_state>> queue;
+		std::vector<Thread> threads;
+		LightSemaphore pending;
+		LightLock lock;
+		size_t idle;
+		size_t max;
+		int core;
 
-		static void _entrypoint(void *arg)
-		{
-			ThreadFuncParams *params = (ThreadFuncParams *) arg;
-			params->func();
-			params->self->isFinished = true;
-			delete params;
-		}
+		static void entrypoint(void *arg);
+		bool spawn();
 
-		Thread threadobj;
-		bool isFinished;
+		/* removes state from the queue, returns false if a thread already took it */
+		bool claim(const std::shared_ptr<detail::task_state>& state);
+		friend class task;
 
 
 	};
 
 	template <typename ... Ts>
-	class reuse_thread
+	class thread
 	{
 	public:
-		/* will run a new thread, but first finished the previous one */
-		thread<Ts...> *run(std::function<void(Ts...)> cb, Ts& ... args)
+		/* create a new thread, it runs on ctr::pool::global() but always starts right away */
+		thread(std::function<void(Ts...)> cb, int prioAddition, Ts& ... args)
 		{
-			this->cleanup();
-			return this->th = new thread<Ts...>(cb, -1, args...);
+			/* cb has to be copied, it's gone once the constructor returns */
+			this->t = pool::global().run([cb, &args...]() -> void { cb(args...); }, prioAddition, true);
 		}
 
-		/* returns the current active thread, and nullptr if there is none */
-		thread<Ts...> *current_thread() { return this->th; }
-		~reuse_thread() { this->cleanup(); }
+		~thread()
+		{
+			this->join();
+		}
 
+		/* wait for the thread to finish */
+		void join()
+		{
+			this->t.join();
+		}
 
-	private:
-		void cleanup()
+		/* returns if the thread is done */
+		bool finished()
 		{
-			if(this->th != nullptr)
-			{
-				this->th->join();
-				delete this->th;
-				this->th = nullptr;
-			}
+			return this->t.finished();
 		}
 
-		thread<Ts...> *th = nullptr;
+
+	private:
+		task t;
 
 
 	};
@@ -0,0 +1,47 @@
+/* This file is part of 3hs
+ * Copyright (C) 2021-2022 hShop developer team
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef inc_titledb_hh
+#define inc_titledb_hh
+
+#include <vector>
+#include <3ds.h>
+
+
+/* persistent list of the titles installed on the SD and NAND with their versions, only
+ * rebuilt from AM when the title ids AM lists change, which is checked once per session.
+ * versions can be outdated if a title was updated outside of 3hs, see verify_version() */
+namespace titledb
+{
+	/* has to be called before anything else */
+	void init();
+
+	/* appends the title ids installed on the SD, NAND and game card to ret */
+	Result list(std::vector<u64>& ret);
+	/* gets the installed version of tid, returns false if it isn't installed */
+	bool version(u64 tid, u16& ver);
+	/* like version(), but asks AM and corrects the database if needed. use it
+	 * before acting on a version, it costs an AM call per title */
+	bool verify_version(u64 tid, u16& ver);
+
+	/* call after tid was installed to media */
+	void installed(u64 tid, FS_MediaType media);
+	/* call after tid was deleted from media */
+	void removed(u64 tid, FS_MediaType media);
+}
+
+#endif
+
@@ -66,6 +66,8 @@ namespace ui
 
 	/* run a loading animation (class Spinner) while running `callback`. callback is ran on the same thread as the caller of the function.*/
 	void loading(std::function<void()> callback);
+	/* run a loading animation on the calling thread until `done` returns true, for work that already runs elsewhere */
+	void loading_until(std::function<bool()> done);
  	/**
 	 * use `$t' as a placeholder for the seconds left until the end of the timeout
 	 * returns true if the user cancelled the timeout (if allowed)
@@ -0,0 +1,18 @@
+<!DOCTYPE html>
+<html>
+	<head>
+		<meta charset="utf-8"/>
+		<title>hLink | status</title>
+	</head>
+	<body>
+		<h3>File cache</h3>
+		<table>
+			<tr><td>Hits</td><td>[cache-hits]</td></tr>
+			<tr><td>Misses</td><td>[cache-misses]</td></tr>
+			<tr><td>Evictions</td><td>[cache-evictions]</td></tr>
+			<tr><td>Entries</td><td>[cache-entries]</td></tr>
+			<tr><td>Size</td><td>[cache-size] / [cache-max] bytes</td></tr>
+		</table>
+		<a href="/index.html">Back to home</a>
+	</body>
+</html>
@@ -15,6 +15,7 @@
  */
 
 #include "install.hh"
+#include "titledb.hh"
 #include "error.hh"
 #include "panic.hh"
 #include "ctr.hh"
@@ -242,8 +243,12 @@ Result ctr::delete_title(u64 tid, FS_MediaType media, bool and_ticket, bool chec
 	if(and_ticket && (!check_exist || ctr::ticket_exists(tid)) && R_FAILED(res = AM_DeleteTicket(tid)))
 		return res;
 
-	if((!check_exist || (ctr::title_exists(tid, media))) && R_FAILED(res = AM_DeleteTitle(media, tid)))
-		return res;
+	if(!check_exist || ctr::title_exists(tid, media))
+	{
+		if(R_FAILED(res = AM_DeleteTitle(media, tid)))
+			return res;
+		titledb::removed(tid, media);
+	}
 
 	return 0;
 }
@@ -39,6 +39,9 @@
  *     - the other file has a variable name found in config.ini
  */
 
+/* size of the buffer the forwarded file is copied with */
+#define COPY_SIZE 0x10000
+
 static u8 *read_rs(nnc_rstream *rs, size_t *len)
 {
 	*len = NNC_RS_PCALL0(rs, size);
@@ -49,18 +52,34 @@ static u8 *read_rs(nnc_rstream *rs, size_t *len)
 	return contents;
 }
 
-/* prototyped in install.hh */
-Result install_forwarder(u8 *data, size_t len)
+/* copies rs to out without holding all of it in memory */
+static bool copy_rs(nnc_rstream *rs, FILE *out)
+{
+	u32 left = NNC_RS_PCALL0(rs, size), readSize;
+	u8 *buffer = (u8 *) malloc(COPY_SIZE);
+	bool ret = buffer != NULL;
+
+	while(ret && left != 0)
+	{
+		if(NNC_RS_PCALL(rs, read, buffer, left < COPY_SIZE ? left : COPY_SIZE, &readSize) != NNC_R_OK || readSize == 0
+			|| fwrite(buffer, readSize, 1, out) != 1)
+			ret = false;
+		else left -= readSize;
+	}
+
+	free(buffer);
+	return ret;
+}
+
+static Result install_forwarder_rs(nnc_rstream *cia)
 {
 	nnc_keyset kset;
 	nnc_keyset_default(&kset, false);
 
-	nnc_memory cia;
-	nnc_mem_open(&cia, data, len);
-
 	nnc_cia_content_reader reader;
 	nnc_cia_header header;
 	u8 *contents = NULL;
+	size_t len;
 	char *contents_s, *dest, *src, *end, *slash;
 	nnc_romfs_ctx romfs;
 	nnc_ncch_section_stream romfsSection;
@@ -77,8 +96,8 @@ Result install_forwarder(u8 *data, size_t len)
 	const char *locstr = "location=";
 	const size_t locstrlen = strlen(locstr);
 
-	if(nnc_read_cia_header(NNC_RSP(&cia), &header) != NNC_R_OK) return APPERR_FILEFWD_FAIL;
-	if(nnc_cia_make_reader(&header, NNC_RSP(&cia), &kset, &reader) != NNC_R_OK) return APPERR_FILEFWD_FAIL;
+	if(nnc_read_cia_header(cia, &header) != NNC_R_OK) return APPERR_FILEFWD_FAIL;
+	if(nnc_cia_make_reader(&header, cia, &kset, &reader) != NNC_R_OK) return APPERR_FILEFWD_FAIL;
 	if(nnc_cia_open_content(&reader, 0, &ncch0, NULL) != NNC_R_OK) goto fail;
 	if(nnc_read_ncch_header(NNC_RSP(&ncch0), &ncchHeader) != NNC_R_OK) goto fail;
 	/* we don't need a seeddb here since theme installers will never use a seed */
@@ -123,11 +142,9 @@ Result install_forwarder(u8 *data, size_t len)
 
 	if(nnc_get_info(&romfs, &info, src) != NNC_R_OK) goto fail2;
 	if(nnc_romfs_open_subview(&romfs, &sv, &info)) goto fail2;
-	free(contents);
-	if(!(contents = read_rs(NNC_RSP(&sv), &len))) goto fail2;
 	out = fopen(rdest.c_str(), "w");
 	if(!out) goto fail2;
-	if(fwrite(contents, len, 1, out) != 1) goto fail2;
+	if(!copy_rs(NNC_RSP(&sv), out)) goto fail2;
 
 	fclose(out);
 	nnc_free_romfs(&romfs);
@@ -143,3 +160,26 @@ fail:
 	return APPERR_FILEFWD_FAIL;
 }
 
+/* prototyped in install.hh */
+Result install_forwarder(u8 *data, size_t len)
+{
+	nnc_memory cia;
+	nnc_mem_open(&cia, data, len);
+	return install_forwarder_rs(NNC_RSP(&cia));
+}
+
+/* prototyped in install.hh */
+Result install_forwarder(const char *path)
+{
+	nnc_file cia;
+	Result res;
+	if(nnc_file_open(&cia, path) != NNC_R_OK)
+	{
+		elog("failed to open %s", path);
+		return APPERR_FILEFWD_FAIL;
+	}
+	res = install_forwarder_rs(NNC_RSP(&cia));
+	NNC_RS_CALL0(cia, close);
+	return res;
+}
+
@@ -16,6 +16,7 @@
 
 #include "find_missing.hh"
 #include "install.hh"
+#include "titledb.hh"
 #include "hsapi.hh"
 #include "queue.hh"
 #include "panic.hh"
@@ -23,6 +24,7 @@
 #include "log.hh"
 
 #include <ui/loading.hh>
+#include <ui/confirm.hh>
 
 #include <unordered_set>
 #include <algorithm>
@@ -40,18 +42,16 @@ bool tid_can_have_missing(hsapi::htid tid)
 
 ssize_t show_find_missing(hsapi::htid tid)
 {
-	ssize_t ret = -1;
-	ui::loading([&tid, &ret]() -> void {
-		std::vector<hsapi::htid> installed;
-		panic_if_err_3ds(ctr::list_titles_on(MEDIATYPE_SD, installed));
-		panic_if_err_3ds(ctr::list_titles_on(MEDIATYPE_NAND, installed)); // mostly for streetpass dlc
-		ctr::list_titles_on(MEDIATYPE_GAME_CARD, installed); // it might error if there is no cart inserted so we don't want to panic if it fails
+	std::vector<hsapi::htid> installed;
+	std::vector<hsapi::htid> installedGames;
+	ui::loading([&tid, &installed, &installedGames]() -> void {
+		/* SD, NAND (mostly for streetpass dlc) and game card */
+		panic_if_err_3ds(titledb::list(installed));
 
 		std::vector<hsapi::htid> doCheckOn;
 		if(tid == 0) doCheckOn = installed;
 		else doCheckOn.push_back(tid);
 
-		std::vector<hsapi::htid> installedGames;
 		std::copy_if(doCheckOn.begin(), doCheckOn.end(), std::back_inserter(installedGames), tid_can_have_missing);
 		/* deduplicate installedGames based on unique id */
 		std::unordered_set<u32> dedupe;
@@ -67,32 +67,60 @@ ssize_t show_find_missing(hsapi::htid tid)
 				--i;
 			}
 		}
+	});
+	if(installedGames.size() == 0)
+		return 0;
+
+	/* the related titles are fetched in chunks, so we can show how far along we are */
+	hsapi::BatchRelated related;
+	Result res;
+	do {
+		related.clear();
+		ui::LoadingBar bar(installedGames.size());
+		size_t shown = 0;
+		res = hsapi::batch_related(related, installedGames, [&bar, &shown](size_t done, size_t) -> void {
+			bar.update(done - shown);
+			shown = done;
+		});
+		if(R_FAILED(res))
+		{
+			error_container err = get_error(res);
+			report_error(err);
+			handle_error(err);
+			if(!ui::Confirm::exec(STRING(retry_req)))
+				return -1;
+		}
+	} while(R_FAILED(res));
 
-		hsapi::BatchRelated related;
-		Result res = hsapi::call<hsapi::BatchRelated&, const std::vector<hsapi::htid>&>(hsapi::batch_related, related, installedGames);
-		if(R_FAILED(res)) return;
-
+	ssize_t ret = -1;
+	ui::loading([&installed, &installedGames, &related, &ret]() -> void {
 		std::vector<hsapi::FullTitle> potentialInstalls;
 
 		for(size_t i = 0; i < installedGames.size(); ++i)
 			vecappend(potentialInstalls, related[installedGames[i]]);
 
+		std::unordered_set<hsapi::htid> installedSet(installed.begin(), installed.end());
+		std::unordered_set<hsapi::hid> queued;
+		for(const hsapi::FullTitle& title : queue_get())
+			queued.insert(title.id);
+
 		std::vector<hsapi::FullTitle> newInstalls;
-		std::copy_if(potentialInstalls.begin(), potentialInstalls.end(), std::back_inserter(newInstalls), [installed](const hsapi::FullTitle& title) -> bool {
+		std::copy_if(potentialInstalls.begin(), potentialInstalls.end(), std::back_inserter(newInstalls), [&installedSet, &queued](const hsapi::FullTitle& title) -> bool {
 			/* don't import demo's */
 			if(ctr::get_tid_cat(title.tid) == 0x2)
 				return false;
 			/* already in queue */
-			if(std::find(queue_get().begin(), queue_get().end(), title) != queue_get().end())
+			if(queued.find(title.id) != queued.end())
 				return false;
 			/* not installed */
-			if(std::find(installed.begin(), installed.end(), title.tid) == installed.end())
+			if(installedSet.find(title.tid) == installedSet.end())
 				return true;
-			AM_TitleEntry te;
-			if(R_FAILED(ctr::get_title_entry(title.tid, te)))
-				return false;
+			u16 version;
 			/* installed version is lower than version on server */
-			return title.version > te.version;
+			if(!titledb::version(title.tid, version) || title.version <= version)
+				return false;
+			/* updates from elsewhere don't reach the database, so make sure with AM */
+			return titledb::verify_version(title.tid, version) && title.version > version;
 		});
 
 		for(const hsapi::FullTitle& title : newInstalls)
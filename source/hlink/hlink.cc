@@ -31,6 +31,7 @@
 #include <errno.h>
 
 #include <unordered_map>
+#include <vector>
 
 #include "install.hh"
 #include "thread.hh"
@@ -68,7 +69,32 @@ typedef struct iTransactionResponse
 	uint32_t size;
 } __attribute__((__packed__)) iTransactionResponse;
 
-static bool g_lock = false; // is a hlink transaction going on?
+enum class conn_kind { http, hlink };
+
+/* a client connection, owned by the event loop while the request head comes in
+ * and by a handler on the pool afterwards */
+typedef struct connection
+{
+	hlink::HTTPRequestContext ctx; /* hLink connections only use fd, clientaddr and buf */
+	conn_kind kind;
+	u64 lastActive;
+	size_t served; /* requests answered on this connection */
+} connection;
+
+/* state shared between the event loop and the handlers */
+typedef struct server_state
+{
+	LightLock lock;
+	LightLock queueLock; /* the queue isn't thread safe */
+	std::vector<std::string> errors; /* the event loop displays these */
+	std::vector<connection *> returned; /* persistent connections handlers are done with */
+	size_t active; /* handlers running */
+	bool exclusive; /* an action that can't run next to others is going on */
+	bool launch; /* the event loop should shut down and jump to launchTid */
+	u64 sleepUntil; /* the event loop doesn't take requests before this time */
+	u64 launchTid;
+	FS_MediaType launchMedia;
+} server_state;
 
 using trust_store_t = std::unordered_map<in_addr_t, bool>;
 
@@ -113,8 +139,15 @@ static void send_response(int clientfd, hlink::response resp)
 	send(clientfd, &respb, sizeof(iTransactionResponse), 0);
 }
 
+/* ret may already hold the start of the body */
 static int read_whole_body(int clientfd, std::string& ret, iTransactionHeader header)
 {
+	/* the size comes from the client, don't let it make us allocate whatever it wants */
+	if(header.size > hlink::max_body)
+	{
+		send_response(clientfd, hlink::response::error, "body too large");
+		return EMSGSIZE;
+	}
 	ret.reserve(header.size);
 
 	struct pollfd clientpoll;
@@ -124,7 +157,7 @@ static int read_whole_body(int clientfd, std::string& ret, iTransactionHeader he
 	char buf[1024];
 	int seqbad = 0;
 
-	do
+	while(ret.size() < header.size)
 	{
 		if(seqbad > hlink::max_timeouts) break;
 		if(poll(&clientpoll, 1, hlink::poll_timeout_body) == 0)
@@ -134,125 +167,144 @@ static int read_whole_body(int clientfd, std::string& ret, iTransactionHeader he
 		}
 		else seqbad = 0;
 
-		ssize_t recvd = recv(clientfd, buf, 1024, 0);
-		if(recvd < 0) break;
+		/* don't read past the body */
+		size_t left = header.size - ret.size();
+		ssize_t recvd = recv(clientfd, buf, left < sizeof(buf) ? left : sizeof(buf), 0);
+		if(recvd <= 0) break;
 		ret += std::string(buf, recvd);
-	} while(ret.size() != header.size);
+	}
 
 	if(ret.size() < header.size) return errno;
 	return 0;
 }
 
-static void handle_add_queue(int clientfd, iTransactionHeader header)
+static void report_error(server_state& state, const std::string& err)
+{
+	LightLock_Lock(&state.lock);
+	state.errors.push_back(err);
+	LightLock_Unlock(&state.lock);
+}
+
+/* returns false if another exclusive action is going on */
+static bool begin_exclusive(server_state& state)
+{
+	bool ret = false;
+	LightLock_Lock(&state.lock);
+	if(!state.exclusive)
+		ret = state.exclusive = true;
+	LightLock_Unlock(&state.lock);
+	return ret;
+}
+
+static bool is_exclusive(server_state& state)
+{
+	LightLock_Lock(&state.lock);
+	bool ret = state.exclusive;
+	LightLock_Unlock(&state.lock);
+	return ret;
+}
+
+/* the event loop closes all connections before jumping, begin_exclusive() must have succeeded */
+static void request_launch(server_state& state, u64 tid, FS_MediaType media)
+{
+	LightLock_Lock(&state.lock);
+	state.launchTid = tid;
+	state.launchMedia = media;
+	state.launch = true;
+	LightLock_Unlock(&state.lock);
+}
+
+/* the sleep action, new requests wait until it's over. the event loop does the
+ * waiting so the handler that asked for it is free in the meantime */
+static void request_sleep(server_state& state)
+{
+	LightLock_Lock(&state.lock);
+	state.sleepUntil = osGetTime() + SLEEP_AMOUNT * 1000;
+	LightLock_Unlock(&state.lock);
+}
+
+static void handle_add_queue(int clientfd, server_state& state, iTransactionHeader header, std::string& body)
 {
-	std::string body;
 	if(read_whole_body(clientfd, body, header) != 0)
 		return;
 
 	if(body.size() % sizeof(u64) != 0)
 		return send_response(clientfd, hlink::response::error, "body.size() % sizeof(u64) != 0");
 
+	std::vector<hsapi::hid> ids;
+	ids.reserve(body.size() / sizeof(hsapi::hid));
 	for(size_t i = 0; i < body.size() / sizeof(hsapi::hid); ++i)
-	{
-		hsapi::hid id = ntohll(((const hsapi::hid *) body.data())[i]);
-
-		hsapi::FullTitle meta;
-		if(R_FAILED(hsapi::title_meta(meta, id)))
-			continue;
-		queue_add(meta);
-	}
+		ids.push_back(ntohll(((const hsapi::hid *) body.data())[i]));
+	LightLock_Lock(&state.queueLock);
+	queue_add(ids);
+	LightLock_Unlock(&state.queueLock);
 
 	send_response(clientfd, hlink::response::success);
 }
 
-static bool handle_launch(int clientfd, int server, hlink::HTTPServer& serv, iTransactionHeader header, std::function<void(const std::string&)> disp_error)
+static void handle_launch(int clientfd, server_state& state, iTransactionHeader header, std::string& body)
 {
 	if(header.size != sizeof(uint64_t))
-	{
-		send_response(clientfd, hlink::response::error, "body.size() != sizeof(uint64_t)");
-		return false;
-	}
+		return send_response(clientfd, hlink::response::error, "body.size() != sizeof(uint64_t)");
 
-	std::string body;
 	if(read_whole_body(clientfd, body, header) != 0)
-		return false;
+		return;
 
 	uint64_t tid = ntohll(* (uint64_t *) body.data());
 	FS_MediaType media = ctr::mediatype_of(tid);
 
 	if(!ctr::title_exists(tid, media))
 	{
-		disp_error(PSTRING(title_doesnt_exist, ctr::tid_to_str(tid)));
-		send_response(clientfd, hlink::response::notfound);
-		return false;
+		report_error(state, PSTRING(title_doesnt_exist, ctr::tid_to_str(tid)));
+		return send_response(clientfd, hlink::response::notfound);
 	}
 
-	send_response(clientfd, hlink::response::success);
-
-	close(clientfd);
-	close(server);
-	serv.close();
-	g_lock = false;
-
-	APT_PrepareToDoApplicationJump(0, tid, media);
+	if(!begin_exclusive(state))
+		return send_response(clientfd, hlink::response::busy);
 
-	u8 parambuf[0x300];
-	u8 hmacbuf[0x20];
-	APT_DoApplicationJump(parambuf, 0x300, hmacbuf);
-
-	return true; // reachable only if APT_DoApplicationJump fails
+	send_response(clientfd, hlink::response::success);
+	request_launch(state, tid, media);
 }
 
-static bool handle_request(int clientfd, int serverfd, hlink::HTTPServer serv, const char *clientaddr,
-	std::function<void(const std::string&)> disp_req,
-	std::function<void(const std::string&)> disp_error)
+static void handle_request(connection *conn, server_state& state)
 {
+	int clientfd = conn->ctx.fd;
+	/* the event loop made sure the header is in the buffer and valid */
 	iTransactionHeader header;
-	ssize_t recvd = recv(clientfd, &header, sizeof(header), 0);
-	if(recvd < 0) // error
-		goto cleanup;
-
-	header.size = ntohll(header.size);
-	if(memcmp(header.magic, hlink::transaction_magic, hlink::transaction_magic_len) != 0)
-	{
-		send_response(clientfd, hlink::response::error, "invalid magic");
-		goto cleanup;
-	}
-
-	disp_req(std::string(clientaddr) + "\n" + action2string(header.action));
+	memcpy(&header, conn->ctx.buf, sizeof(header));
+	header.size = ntohl(header.size);
+	std::string body(conn->ctx.buf + sizeof(header), conn->ctx.buflen - sizeof(header));
 
 	switch(header.action)
 	{
 	case hlink::action::add_queue:
-		handle_add_queue(clientfd, header);
+		handle_add_queue(clientfd, state, header, body);
 		break;
 	case hlink::action::install_id:
 	case hlink::action::install_url:
 	case hlink::action::install_data:
+		/* installing can't happen next to a launch or another install */
+		if(!begin_exclusive(state))
+			return send_response(clientfd, hlink::response::busy);
 		send_response(clientfd, hlink::response::error, "stub");
+		LightLock_Lock(&state.lock);
+		state.exclusive = false;
+		LightLock_Unlock(&state.lock);
 		break;
 	case hlink::action::nothing:
 		send_response(clientfd, hlink::response::accept);
 		break;
 	case hlink::action::launch:
-		if(handle_launch(clientfd, serverfd, serv, header, disp_error))
-			return true;
+		handle_launch(clientfd, state, header, body);
 		break;
 	case hlink::action::sleep:
 		send_response(clientfd, hlink::response::success);
-		close(clientfd);
-		sleep(SLEEP_AMOUNT);
-		goto no_close;
+		request_sleep(state);
+		break;
 	default:
 		send_response(clientfd, hlink::response::error, "invalid action");
 		break;
 	}
-
-cleanup:
-	close(clientfd);
-no_close:
-	g_lock = false;
-	return false;
 }
 
 static void finish_ctx(hlink::HTTPRequestContext& ctx, hlink::TemplRen& ren, size_t status)
@@ -260,9 +312,8 @@ static void finish_ctx(hlink::HTTPRequestContext& ctx, hlink::TemplRen& ren, siz
 	hlink::TemplRen::result code;
 	std::string res;
 
-	std::string src;
-	ctx.read_path_content(src);
-	if((code = ren.finish(src, res)) != hlink::TemplRen::result::ok)
+	std::shared_ptr<const std::string> src = ctx.read_path_content();
+	if((code = ren.finish(*src, res)) != hlink::TemplRen::result::ok)
 	{
 		ctx.respond(500, "<!DOCTYPE html><html><body>Failed to render due to a template error. Code = " + std::to_string((int) code)
 			+ ". If you do not know what this code means <a href=\"/doc/3hs-template-language.html\">try reading the documentation</a>."
@@ -271,17 +322,10 @@ static void finish_ctx(hlink::HTTPRequestContext& ctx, hlink::TemplRen& ren, siz
 			{ { "Content-Type", "text/html" } });
 	}
 	else ctx.respond(status, res, { { "Content-Type", "text/html" } });
-	ctx.close();
 }
 
-static bool handle_http_request(hlink::HTTPRequestContext ctx, int serverfd, char *clientaddr, std::function<void(const std::string&)> disp_req,
-	std::function<void(const std::string&)> disp_error)
+static void handle_http_request(hlink::HTTPRequestContext& ctx, server_state& state)
 {
-	disp_req(std::string(clientaddr) + "\n" + ctx.path);
-	((void) disp_error);
-	((void) serverfd);
-
-	/* TODO: Fix concurrency issue: hlink+http blocks? after that segv? */
 	hlink::HTTPRequestContext::serve_type type = ctx.type();
 	switch(type)
 	{
@@ -328,7 +372,9 @@ static bool handle_http_request(hlink::HTTPRequestContext ctx, int serverfd, cha
 			else
 			{
 				status = 200;
+				LightLock_Lock(&state.queueLock);
 				queue_add(meta);
+				LightLock_Unlock(&state.queueLock);
 				ren.use("title-name", meta.name);
 				ren.use("title-hshop-id", std::to_string(meta.id));
 			}
@@ -371,22 +417,29 @@ static bool handle_http_request(hlink::HTTPRequestContext ctx, int serverfd, cha
 				ctr::smdh::get_native_title(smdh)->descShort, 0x40));
 			delete smdh;
 
+			if(!begin_exclusive(state))
+			{
+				ctx.serve_path(429, "/busy.html", { });
+				break;
+			}
+
 			status = 200;
 			finish_ctx(ctx, ren, status);
+			request_launch(state, tid, media);
+			return;
+		}
 
-			close(serverfd);
-			ctx.server->close();
-			g_lock = false;
-
-			APT_PrepareToDoApplicationJump(0, tid, media);
-
-			u8 parambuf[0x300];
-			u8 hmacbuf[0x20];
-			APT_DoApplicationJump(parambuf, 0x300, hmacbuf);
-
-			// TODO: Fix SEGV
-
-			return true;
+		else if(ctx.path == "/status.tpl")
+		{
+			hlink::file_cache_stats stats = hlink::get_file_cache_stats();
+			status = 200;
+			ren.use("cache-hits", std::to_string(stats.hits));
+			ren.use("cache-misses", std::to_string(stats.misses));
+			ren.use("cache-evictions", std::to_string(stats.evictions));
+			ren.use("cache-entries", std::to_string(stats.entries));
+			ren.use("cache-size", std::to_string(stats.size));
+			ren.use("cache-max", std::to_string(stats.max));
+			goto begin_render;
 		}
 
 		else if(ctx.path == "/sleep.tpl")
@@ -395,8 +448,8 @@ static bool handle_http_request(hlink::HTTPRequestContext ctx, int serverfd, cha
 			ren.use("sleep-amount-2", SLEEP_AMOUNT_S_PLUS_ONE);
 			ren.use("sleep-amount", SLEEP_AMOUNT_S);
 			finish_ctx(ctx, ren, status);
-			sleep(SLEEP_AMOUNT);
-			goto end_render_no_close;
+			request_sleep(state);
+			return;
 		}
 
 		else
@@ -407,14 +460,9 @@ static bool handle_http_request(hlink::HTTPRequestContext ctx, int serverfd, cha
 
 begin_render:
 		finish_ctx(ctx, ren, status);
-		goto end_render_no_close;
+		return;
 	}
 	}
-
-	ctx.close();
-end_render_no_close:
-	g_lock = false;
-	return false;
 }
 
 static bool isallowedtrust(struct sockaddr_in clientaddr, trust_store_t& truststore, std::function<bool(const std::string&)> on_requester)
@@ -439,74 +487,138 @@ static bool isallowedtrust(struct sockaddr_in clientaddr, trust_store_t& trustst
 	return true;
 }
 
-static void handle_http(hlink::HTTPServer& serv, trust_store_t& truststore, int serverfd, ctr::reuse_thread<>& handleThread, bool& keepOpenSignal,
-	std::function<bool(const std::string&)> on_requester, std::function<void(const std::string&)> disp_req, std::function<void(const std::string&)> disp_error)
+static void close_connection(connection *conn)
 {
-	hlink::HTTPRequestContext ctx;
-	if(serv.make_reqctx(ctx) != 0)
-		return;
+	if(conn->ctx.fd != -1)
+		conn->ctx.close();
+	delete conn;
+}
 
-	if(g_lock)
+/* accepts a new connection on listenfd, the request head is read by the event loop */
+static void accept_connection(std::vector<connection *>& conns, conn_kind kind, int listenfd, hlink::HTTPServer& serv,
+	trust_store_t& truststore, std::function<bool(const std::string&)> on_requester, std::function<void(const std::string&)> disp_error)
+{
+	connection *conn = new connection;
+	conn->kind = kind;
+	if(kind == conn_kind::http)
 	{
-		ctx.serve_path(429, "/busy.html", { });
-		ctx.close();
-		return;
+		if(serv.make_reqctx(conn->ctx) != 0)
+		{
+			delete conn;
+			return;
+		}
+	}
+	else
+	{
+		conn->ctx.server = &serv;
+		conn->ctx.iseof = false;
+		conn->ctx.buflen = 0;
+		conn->ctx.skip = 0;
+		memset(&conn->ctx.clientaddr, 0x0, sizeof(conn->ctx.clientaddr));
+		socklen_t clientaddrlen = sizeof(conn->ctx.clientaddr);
+		if((conn->ctx.fd = accept(listenfd, (struct sockaddr *) &conn->ctx.clientaddr, &clientaddrlen)) < 0)
+		{
+			disp_error("accept(): " + std::string(strerror(errno)));
+			delete conn;
+			return;
+		}
 	}
 
-	g_lock = true;
+	if(conns.size() >= hlink::max_connections)
+	{
+		if(kind == conn_kind::http) conn->ctx.serve_path(503, "/busy.html", { });
+		else send_response(conn->ctx.fd, hlink::response::busy);
+		return close_connection(conn);
+	}
 
-	if(!isallowedtrust(ctx.clientaddr, truststore, on_requester))
+	if(!isallowedtrust(conn->ctx.clientaddr, truststore, on_requester))
 	{
-		ctx.serve_403();
-		ctx.close();
-		return;
+		if(kind == conn_kind::http) conn->ctx.serve_403();
+		else send_response(conn->ctx.fd, hlink::response::untrusted);
+		return close_connection(conn);
 	}
 
-	/* we need to make a copy of ctx because else stack corruption */
-	handleThread.run([&ctx, serverfd, disp_req, disp_error, &keepOpenSignal]() -> void {
-		TIMER_START(http_request)
-		if(handle_http_request(ctx, serverfd, inet_ntoa(ctx.clientaddr.sin_addr), disp_req, disp_error))
-			keepOpenSignal = false;
-		TIMER_END(http_request)
-	});
+	conn->lastActive = osGetTime();
+	conn->served = 0;
+	conns.push_back(conn);
 }
 
-static void handle_hlink(int serverfd, trust_store_t& truststore, hlink::HTTPServer& serv, ctr::reuse_thread<>& handleThread, bool& keepOpenSignal,
-	std::function<void(const std::string&)> disp_error, std::function<void(const std::string&)> disp_req, std::function<bool(const std::string&)> on_requester)
+/* returns 1 if the request head isn't complete yet, 0 if it is and -1 if the connection was closed */
+static int feed_connection(connection *conn)
 {
-	struct sockaddr_in clientaddr;
-	socklen_t clientaddrlen = sizeof(clientaddr);
-	memset(&clientaddr, 0x0, sizeof(clientaddr));
-
-	// NOW we need to accept() our connection
-	int clientfd = accept(serverfd, (struct sockaddr *) &clientaddr, &clientaddrlen);
+	conn->lastActive = osGetTime();
+	if(conn->kind == conn_kind::http)
+		return conn->ctx.server->feed_reqctx(conn->ctx);
 
-	if(clientfd < 0)
+	ssize_t len;
+	if((len = recv(conn->ctx.fd, conn->ctx.buf + conn->ctx.buflen, sizeof(conn->ctx.buf) - conn->ctx.buflen, 0)) <= 0)
 	{
-		disp_error("accept(): " + std::string(strerror(errno)));
-		return;
+		conn->ctx.close();
+		return -1;
 	}
+	conn->ctx.buflen += len;
+	return conn->ctx.buflen < sizeof(iTransactionHeader) ? 1 : 0;
+}
 
-	if(g_lock) // we can't have more than 2 connections, so we just say bAi
+/* hands a connection with a complete request head to a handler */
+static void dispatch_connection(connection *conn, ctr::pool& handlers, server_state& state,
+	std::function<void(const std::string&)> disp_req)
+{
+	std::string clientaddr = inet_ntoa(conn->ctx.clientaddr.sin_addr);
+	if(conn->kind == conn_kind::http)
 	{
-		send_response(clientfd, hlink::response::busy);
-		close(clientfd);
-		return;
+		disp_req(clientaddr + "\n" + conn->ctx.path);
+		if(is_exclusive(state))
+		{
+			conn->ctx.keepalive = false;
+			conn->ctx.serve_path(429, "/busy.html", { });
+			return close_connection(conn);
+		}
 	}
-
-	if(!isallowedtrust(clientaddr, truststore, on_requester))
+	else
 	{
-		send_response(clientfd, hlink::response::untrusted);
-		close(clientfd);
-		return;
+		iTransactionHeader *header = (iTransactionHeader *) conn->ctx.buf;
+		if(memcmp(header->magic, hlink::transaction_magic, hlink::transaction_magic_len) != 0)
+		{
+			send_response(conn->ctx.fd, hlink::response::error, "invalid magic");
+			return close_connection(conn);
+		}
+		disp_req(clientaddr + "\n" + action2string(header->action));
+		if(is_exclusive(state))
+		{
+			send_response(conn->ctx.fd, hlink::response::busy);
+			return close_connection(conn);
+		}
 	}
 
-	g_lock = true;
-	handleThread.run([clientfd, serverfd, &serv, clientaddr, disp_req, disp_error, &keepOpenSignal]() -> void {
-		TIMER_START(hlink_request)
-		if(handle_request(clientfd, serverfd, serv, inet_ntoa(clientaddr.sin_addr), disp_req, disp_error))
-			keepOpenSignal = false;
-		TIMER_END(hlink_request)
+	LightLock_Lock(&state.lock);
+	++state.active;
+	LightLock_Unlock(&state.lock);
+
+	handlers.run([conn, &state]() -> void {
+		/* handlers may use hsapi, which must not read input off the UI thread */
+		hsapi::background_scope scope;
+		bool keep = false;
+		if(conn->kind == conn_kind::http)
+		{
+			TIMER_START(http_request)
+			handle_http_request(conn->ctx, state);
+			TIMER_END(http_request)
+			keep = conn->ctx.fd != -1 && conn->ctx.keepalive && conn->ctx.next_request();
+		}
+		else
+		{
+			/* hLink clients send a single transaction per connection */
+			TIMER_START(hlink_request)
+			handle_request(conn, state);
+			TIMER_END(hlink_request)
+		}
+		if(!keep) close_connection(conn);
+
+		LightLock_Lock(&state.lock);
+		if(keep) state.returned.push_back(conn);
+		--state.active;
+		LightLock_Unlock(&state.lock);
 	});
 }
 
@@ -525,6 +637,10 @@ void hlink::create_server(
 		return;
 	}
 
+	/* connections we closed ourselves keep the port busy for a while, the server may be started again before that */
+	int reuse = 1;
+	setsockopt(serverfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
 	struct sockaddr_in servaddr;
 	memset(&servaddr, 0x0, sizeof(servaddr));
 	servaddr.sin_family = AF_INET; // IPv4 only (3ds doesn't support IPv6)
@@ -554,56 +670,135 @@ void hlink::create_server(
 		return;
 	}
 
-	// Now we keep polling
-	constexpr size_t polls_len = 2;
-	struct pollfd serverpolls[polls_len];
-	serverpolls[0].fd = serverfd;
-	serverpolls[0].events = POLLIN;
-	serverpolls[1].fd = httpserv.fd;
-	serverpolls[1].events = POLLIN;
-
-	ctr::reuse_thread<> handleThread;
-	bool keepOpenSignal = true;
-
+	server_state state;
+	LightLock_Init(&state.lock);
+	LightLock_Init(&state.queueLock);
+	state.exclusive = false;
+	state.launch = false;
+	state.sleepUntil = 0;
+	state.active = 0;
+
+	/* the event loop only reads request heads, handlers run here so a slow
+	 * request doesn't hold up the others */
+	ctr::pool *handlers = new ctr::pool(-2, hlink::max_handlers);
+	std::vector<connection *> conns;
+	std::vector<struct pollfd> polls;
 	trust_store_t truststore;
 
-begin_loop:
-	/* if g_lock is set that thread may want to write already */
-	bool haveDispedServ = false;
-	if(!g_lock)
-	{
-		const char *ipaddr = inet_ntoa(servaddr.sin_addr);
-		on_server_create(ipaddr); // We might need to redraw the screen
-		haveDispedServ = true;
-	}
+	/* inet_ntoa() uses a static buffer, handlers never call it */
+	const std::string ipaddr = inet_ntoa(servaddr.sin_addr);
+	bool redraw = true;
 
-	while(keepOpenSignal && (g_lock || on_poll_exit()))
+	while(on_poll_exit())
 	{
-		if(!g_lock && !haveDispedServ)
+		LightLock_Lock(&state.lock);
+		bool launch = state.launch;
+		bool sleeping = osGetTime() < state.sleepUntil;
+		std::vector<std::string> errors;
+		std::vector<connection *> returned;
+		errors.swap(state.errors);
+		/* connections that were given back while sleeping are picked up after */
+		if(!sleeping) returned.swap(state.returned);
+		LightLock_Unlock(&state.lock);
+		if(launch)
+		{
+			for(connection *conn : returned)
+				close_connection(conn);
+			break;
+		}
+
+		/* the next request may already be buffered if the client pipelines */
+		for(connection *conn : returned)
+		{
+			conn->lastActive = osGetTime();
+			++conn->served;
+			if((res = httpserv.take_reqctx(conn->ctx)) == 0)
+				dispatch_connection(conn, *handlers, state, disp_req);
+			else if(res == 1) conns.push_back(conn);
+			else delete conn;
+		}
+
+		for(const std::string& err : errors)
+			disp_error(err);
+		if(errors.size() != 0) redraw = true;
+
+		if(redraw)
 		{
-			const char *ipaddr = inet_ntoa(servaddr.sin_addr);
 			on_server_create(ipaddr); // We might need to redraw the screen
-			haveDispedServ = true;
+			redraw = false;
 		}
 
-		if(poll(serverpolls, polls_len, 1000) == 0)
-			continue; // no events; we do nothing
-		haveDispedServ = false;
-		for(size_t i = 0; i < polls_len; ++i)
+		/* new clients wait in the backlog until we're done sleeping */
+		if(sleeping)
 		{
-			if(!(serverpolls[i].revents & POLLIN))
-				continue; /* this one doesn't have anything */
-			if(serverpolls[i].fd == httpserv.fd)
-				handle_http(httpserv, truststore, serverfd, handleThread, keepOpenSignal, on_requester, disp_req, disp_error);
-			else if(serverpolls[i].fd == serverfd)
-				handle_hlink(serverfd, truststore, httpserv, handleThread, keepOpenSignal, disp_error, disp_req, on_requester);
-			goto begin_loop; /* if we made it here we got a poll that needs updating */
+			svcSleepThread(100000000LL); /* 0.1 seconds */
+			/* the time we spend sleeping doesn't count against the clients */
+			for(connection *conn : conns)
+				conn->lastActive = osGetTime();
+			continue;
+		}
+
+		/* not before the pipelined requests were dispatched above, their handlers may be
+		 * running or even be done already. otherwise we'd only notice after a second */
+		LightLock_Lock(&state.lock);
+		int timeout = state.returned.size() != 0 ? 0 : state.active != 0 ? hlink::poll_timeout_busy : 1000;
+		LightLock_Unlock(&state.lock);
+
+		polls.clear();
+		polls.push_back({ serverfd, POLLIN, 0 });
+		polls.push_back({ httpserv.fd, POLLIN, 0 });
+		for(connection *conn : conns)
+			polls.push_back({ conn->ctx.fd, POLLIN, 0 });
+
+		if(poll(polls.data(), polls.size(), timeout) > 0)
+		{
+			redraw = true;
+			/* polls[i + 2] belongs to conns[i], go backwards so erasing doesn't shift what's left */
+			for(size_t i = conns.size(); i-- > 0; )
+			{
+				if(polls[i + 2].revents == 0)
+					continue;
+				connection *conn = conns[i];
+				if((res = feed_connection(conn)) == 1)
+					continue; /* need more data */
+				conns.erase(conns.begin() + i);
+				if(res == 0) dispatch_connection(conn, *handlers, state, disp_req);
+				else delete conn;
+			}
+
+			if(polls[0].revents & POLLIN)
+				accept_connection(conns, conn_kind::hlink, serverfd, httpserv, truststore, on_requester, disp_error);
+			if(polls[1].revents & POLLIN)
+				accept_connection(conns, conn_kind::http, httpserv.fd, httpserv, truststore, on_requester, disp_error);
+		}
+
+		/* drop clients that take too long to send their request or stay idle for too long */
+		u64 now = osGetTime();
+		for(size_t i = conns.size(); i-- > 0; )
+		{
+			bool idle = conns[i]->served != 0 && conns[i]->ctx.buflen == 0 && conns[i]->ctx.skip == 0;
+			u64 limit = idle ? hlink::keepalive_timeout : hlink::poll_timeout_body * hlink::max_timeouts;
+			if(now - conns[i]->lastActive < limit)
+				continue;
+			close_connection(conns[i]);
+			conns.erase(conns.begin() + i);
 		}
 	}
 
+	delete handlers; /* waits for the running requests */
+	for(connection *conn : state.returned)
+		close_connection(conn);
+	for(connection *conn : conns)
+		close_connection(conn);
 	httpserv.close();
 	close(serverfd);
-	g_lock = false;
-	return;
-}
 
+	if(state.launch)
+	{
+		APT_PrepareToDoApplicationJump(0, state.launchTid, state.launchMedia);
+
+		u8 parambuf[0x300];
+		u8 hmacbuf[0x20];
+		APT_DoApplicationJump(parambuf, 0x300, hmacbuf);
+	}
+}
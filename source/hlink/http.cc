@@ -23,13 +23,29 @@
 
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <errno.h>
 #include <netdb.h>
+#include <sys/stat.h>
+#include <malloc.h>
+#include <dirent.h>
 #include <fcntl.h>
 #include <poll.h>
 
+#include <algorithm>
+#include <memory>
+#include <list>
+
+/* files are read in chunks of this size, aligned for faster reads from romfs */
+#define FILE_CHUNK_SIZE  0x10000
+#define FILE_CHUNK_ALIGN 0x1000
+/* browsers may use cached static files for this long without asking */
+#define STATIC_MAX_AGE "3600"
+/* the most bytes read_path_content() keeps in memory */
+#define FILE_CACHE_MAX 0x40000
+
 /* {{{1 Default status pages */
 void hlink::HTTPRequestContext::serve_400()
 {
@@ -116,7 +132,58 @@ void hlink::HTTPRequestContext::serve_500()
 }
 /* 1}}} */
 
-static std::unordered_map<std::string, std::string> file_cache;
+/* files read with read_path_content(), the least recently used ones are dropped
+ * once they take up more than FILE_CACHE_MAX bytes. entries are never modified so
+ * a hit only hands out another reference */
+typedef struct cache_entry
+{
+	std::shared_ptr<const std::string> data;
+	std::list<std::string>::iterator lru;
+} cache_entry;
+
+static std::unordered_map<std::string, cache_entry> file_cache;
+static std::list<std::string> file_cache_lru; /* most recently used first */
+static hlink::file_cache_stats cache_stats = { 0, 0, 0, 0, 0, FILE_CACHE_MAX };
+/* requests are handled on multiple threads */
+static LightLock file_cache_lock;
+
+void hlink::init_file_cache()
+{
+	LightLock_Init(&file_cache_lock);
+}
+
+hlink::file_cache_stats hlink::get_file_cache_stats()
+{
+	LightLock_Lock(&file_cache_lock);
+	hlink::file_cache_stats ret = cache_stats;
+	LightLock_Unlock(&file_cache_lock);
+	return ret;
+}
+
+/* file_cache_lock must be held */
+static void file_cache_insert(const std::string& path, std::shared_ptr<const std::string> data)
+{
+	/* another thread may have read it in the meantime */
+	if(file_cache.count(path) != 0 || data->size() > FILE_CACHE_MAX)
+		return;
+
+	while(cache_stats.size + data->size() > FILE_CACHE_MAX)
+	{
+		auto it = file_cache.find(file_cache_lru.back());
+		cache_stats.size -= it->second.data->size();
+		--cache_stats.entries;
+		++cache_stats.evictions;
+		file_cache.erase(it);
+		file_cache_lru.pop_back();
+	}
+
+	file_cache_lru.push_front(path);
+	cache_entry& entry = file_cache[path];
+	entry.data = data;
+	entry.lru = file_cache_lru.begin();
+	cache_stats.size += data->size();
+	++cache_stats.entries;
+}
 
 
 int hlink::HTTPServer::make_fd()
@@ -127,6 +194,10 @@ int hlink::HTTPServer::make_fd()
 	if((serverfd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0)
 		return errno;
 
+	/* like the hLink port, see hlink::create_server() */
+	int reuse = 1;
+	setsockopt(serverfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
 	struct sockaddr_in servaddr;
 	memset(&servaddr, 0x0, sizeof(servaddr));
 	servaddr.sin_family = AF_INET; // IPv4 only (3ds doesn't support IPv6)
@@ -147,9 +218,70 @@ int hlink::HTTPServer::make_fd()
 
 	this->root = "romfs:/public"; /* default root dir is romfs:/public/ */
 	this->fd = serverfd;
+	this->files.clear();
+	this->index_files("/");
+
+	/* the build puts precompressed copies next to text files */
+	for(auto& it : this->files)
+	{
+		const std::string& path = it.first;
+		if(path.size() > 3 && path.compare(path.size() - 3, 3, ".gz") == 0)
+		{
+			auto orig = this->files.find(path.substr(0, path.size() - 3));
+			if(orig != this->files.end())
+				orig->second.gzipped = true;
+		}
+	}
 	return 0;
 }
 
+void hlink::HTTPServer::index_files(const std::string& dir)
+{
+	DIR *d = opendir((this->root + dir).c_str());
+	if(!d) return;
+
+	char *buf = (char *) memalign(FILE_CHUNK_ALIGN, FILE_CHUNK_SIZE);
+	struct dirent *ent;
+	struct stat st;
+	while(buf && (ent = readdir(d)))
+	{
+		if(strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
+			continue;
+		std::string path = dir + ent->d_name;
+		if(stat((this->root + path).c_str(), &st) != 0)
+			continue;
+		if(S_ISDIR(st.st_mode))
+		{
+			this->index_files(path + "/");
+			continue;
+		}
+
+		FILE *f = fopen((this->root + path).c_str(), "rb");
+		if(!f) continue;
+		/* FNV-1a over the contents, romfs has no modification times to use instead */
+		u64 hash = 0xCBF29CE484222325;
+		size_t total = 0, r;
+		while((r = fread(buf, 1, FILE_CHUNK_SIZE, f)) != 0)
+		{
+			for(size_t i = 0; i < r; ++i)
+				hash = (hash ^ (u8) buf[i]) * 0x100000001B3;
+			total += r;
+		}
+		fclose(f);
+
+		char etag[40];
+		snprintf(etag, sizeof(etag), "\"%lX-%016llX\"", (unsigned long) total, hash);
+		static_file& file = this->files[path];
+		file.etag = etag;
+		file.size = total;
+		file.gzipped = false;
+		vlog("(HTTP) Indexed %s, size=%lu,etag=%s", path.c_str(), (unsigned long) total, etag);
+	}
+
+	free(buf);
+	closedir(d);
+}
+
 std::string hlink::HTTPServer::errmsg(int code)
 {
 	return strerror(code);
@@ -173,14 +305,17 @@ void hlink::HTTPRequestContext::close()
 
 void hlink::HTTPRequestContext::redirect(const std::string& location)
 {
-	this->respond(303, { { "Location", location } });
+	this->respond(303, { { "Location", location }, { "Content-Length", "0" } });
 }
 
 void hlink::HTTPRequestContext::respond(int status, const std::string& data, HTTPHeaders headers)
 {
 	headers["Content-Length"] = std::to_string(data.size());
-	this->respond(status, headers);
-	this->send(data);
+	/* one send for the whole response */
+	std::string msg = this->head(status, headers);
+	if(!this->is_head())
+		msg += data;
+	this->send(msg);
 }
 
 void hlink::HTTPRequestContext::respond_chunked(int status, HTTPHeaders headers)
@@ -190,6 +325,11 @@ void hlink::HTTPRequestContext::respond_chunked(int status, HTTPHeaders headers)
 }
 
 void hlink::HTTPRequestContext::respond(int status, const HTTPHeaders& headers)
+{
+	this->send(this->head(status, headers));
+}
+
+std::string hlink::HTTPRequestContext::head(int status, const HTTPHeaders& headers)
 {
 	panic_assert(this->fd != -1, "tried to respond to unbound context");
 	const char *msg = nullptr;
@@ -264,29 +404,68 @@ void hlink::HTTPRequestContext::respond(int status, const HTTPHeaders& headers)
 	using Iterator = hlink::HTTPHeaders::const_iterator;
 	for(Iterator it = headers.begin(); it != headers.end(); ++it)
 		body += it->first + ": " + it->second + "\r\n";
+	body += this->keepalive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
 	body += "\r\n";
-
-	this->send(body);
+	return body;
 }
 
 void hlink::HTTPRequestContext::send_chunk(const std::string& data)
 {
 	panic_assert(this->fd != -1, "tried to send chunk to unbound context");
 	char hexbuf[17]; /* max is FFFFFFFFFFFFFFFF which is 16 chars */
-	snprintf(hexbuf, sizeof(hexbuf), "%16X", data.size());
-	std::string rdata = std::string(hexbuf) + "\r\n" + data;
+	snprintf(hexbuf, sizeof(hexbuf), "%lX", (unsigned long) data.size());
+	std::string rdata = std::string(hexbuf) + "\r\n" + data + "\r\n";
 	this->send(rdata);
 }
 
 void hlink::HTTPRequestContext::send(const std::string& data)
+{
+	this->send(data.c_str(), data.size());
+}
+
+bool hlink::HTTPRequestContext::send(const char *data, size_t len)
 {
 	panic_assert(this->fd != -1, "tried to send to unbound context");
-	::send(this->fd, data.c_str(), data.size(), 0);
+	ssize_t sent;
+	/* send() may take less than we give it */
+	while(len != 0)
+	{
+		if((sent = ::send(this->fd, data, len, 0)) <= 0)
+		{
+			if(sent < 0 && errno == EINTR) continue;
+			this->keepalive = false;
+			return false;
+		}
+		data += sent;
+		len -= sent;
+	}
+	return true;
+}
+
+bool hlink::HTTPRequestContext::send_file(FILE *f, size_t offset, size_t len)
+{
+	if(fseek(f, offset, SEEK_SET) != 0)
+		return false;
+	char *buf = (char *) memalign(FILE_CHUNK_ALIGN, FILE_CHUNK_SIZE);
+	if(!buf) return false;
+
+	bool ret = true;
+	size_t r;
+	while(len != 0)
+	{
+		if((r = fread(buf, 1, len < FILE_CHUNK_SIZE ? len : FILE_CHUNK_SIZE, f)) == 0
+				|| !this->send(buf, r))
+		{ ret = false; break; }
+		len -= r;
+	}
+
+	free(buf);
+	return ret;
 }
 
 void hlink::HTTPRequestContext::serve_file(int status, const std::string& fname, HTTPHeaders headers)
 {
-	FILE *f = fopen(fname.c_str(), "r");
+	FILE *f = fopen(fname.c_str(), "rb");
 	if(f == nullptr)
 	{
 		switch(errno)
@@ -301,65 +480,217 @@ void hlink::HTTPRequestContext::serve_file(int status, const std::string& fname,
 		}
 	}
 
-	size_t total, sent = 0;
-
 	fseek(f, 0, SEEK_END);
-	total = ftell(f);
+	size_t total = ftell(f);
 	headers["Content-Length"] = std::to_string(total);
-	fseek(f, 0, SEEK_SET);
 	this->respond(status, headers);
+	/* a client that stops halfway must not get the rest as a new response */
+	if(!this->is_head() && !this->send_file(f, 0, total))
+		this->keepalive = false;
+	fclose(f);
+}
+
+/* parses a "bytes=" range header, returns 1 if [start, end] should be sent, 0 if
+ * the whole file should be sent and -1 if the range can't be satisfied */
+static int parse_range(const std::string& range, size_t total, size_t& start, size_t& end)
+{
+	/* multiple ranges need multipart responses, we just send everything */
+	if(range.compare(0, 6, "bytes=") != 0 || range.find(',') != std::string::npos)
+		return 0;
+
+	std::string::size_type dash = range.find('-', 6);
+	if(dash == std::string::npos) return 0;
+	std::string first = range.substr(6, dash - 6);
+	std::string last = range.substr(dash + 1);
+	char *endp;
+
+	if(first.size() == 0) /* bytes=-n, the last n bytes */
+	{
+		size_t n = strtoul(last.c_str(), &endp, 10);
+		if(endp == last.c_str() || *endp) return 0;
+		if(n == 0 || total == 0) return -1;
+		start = n > total ? 0 : total - n;
+		end = total - 1;
+		return 1;
+	}
 
-	char buf[4098];
-	while(sent != total)
+	start = strtoul(first.c_str(), &endp, 10);
+	if(*endp) return 0;
+	if(last.size() == 0) end = total - 1; /* bytes=n- */
+	else
 	{
-		size_t toSend = fread(buf, 1, sizeof(buf), f);
-		::send(this->fd, buf, toSend, 0);
-		sent += toSend;
+		end = strtoul(last.c_str(), &endp, 10);
+		if(*endp || end < start) return 0;
+		if(end >= total) end = total - 1;
+	}
+	return start < total ? 1 : -1;
+}
+
+void hlink::HTTPRequestContext::serve_static(const static_file& file, const std::string& fname, HTTPHeaders headers)
+{
+	headers["ETag"] = file.etag;
+	headers["Cache-Control"] = "max-age=" STATIC_MAX_AGE;
+	headers["Accept-Ranges"] = "bytes";
+
+	auto it = this->headers.find("if-none-match");
+	/* may be a list of etags */
+	if(it != this->headers.end() && (it->second == "*" || it->second.find(file.etag) != std::string::npos))
+	{
+		/* 304 never has a body */
+		this->respond(304, headers);
+		return;
 	}
 
+	size_t start = 0, end = file.size - 1;
+	int status = 200;
+	it = this->headers.find("range");
+	/* if-range asks for the whole file if it changed */
+	auto ifrange = this->headers.find("if-range");
+	if(it != this->headers.end() && (ifrange == this->headers.end() || ifrange->second == file.etag))
+	{
+		switch(parse_range(it->second, file.size, start, end))
+		{
+		case -1:
+			headers["Content-Range"] = "bytes */" + std::to_string(file.size);
+			this->respond(416, "", headers);
+			return;
+		case 1:
+			status = 206;
+			headers["Content-Range"] = "bytes " + std::to_string(start) + "-"
+				+ std::to_string(end) + "/" + std::to_string(file.size);
+			break;
+		}
+	}
+
+	FILE *f = fopen(fname.c_str(), "rb");
+	if(f == nullptr)
+	{
+		elog("Failed to open indexed file %s, errno=%i: %s", fname.c_str(), errno, strerror(errno));
+		this->serve_500();
+		return;
+	}
+
+	size_t len = file.size == 0 ? 0 : end - start + 1;
+	headers["Content-Length"] = std::to_string(len);
+	this->respond(status, headers);
+	if(!this->is_head() && !this->send_file(f, start, len))
+		this->keepalive = false;
 	fclose(f);
 }
 
 void hlink::HTTPRequestContext::serve_path(int status, const std::string& path, HTTPHeaders headers)
 {
 	this->path = path; /* sneaky */
-	std::string content;
-	this->read_path_content(content);
-	this->respond(status, content, headers);
+	this->respond(status, *this->read_path_content(), headers);
 }
 
-void hlink::HTTPRequestContext::read_path_content(std::string& buf)
+std::shared_ptr<const std::string> hlink::HTTPRequestContext::read_path_content()
 {
+	LightLock_Lock(&file_cache_lock);
 	auto it = file_cache.find(this->path);
 	if(it != file_cache.end())
 	{
-		buf = it->second;
-		return;
+		file_cache_lru.splice(file_cache_lru.begin(), file_cache_lru, it->second.lru);
+		++cache_stats.hits;
+		std::shared_ptr<const std::string> ret = it->second.data;
+		LightLock_Unlock(&file_cache_lock);
+		return ret;
 	}
+	++cache_stats.misses;
+	LightLock_Unlock(&file_cache_lock);
 
+	std::shared_ptr<std::string> buf = std::make_shared<std::string>();
 	FILE *f = fopen((this->server->root + this->path).c_str(), "r");
-	if(f == nullptr) return;
+	if(f == nullptr) return buf; /* not cached so it's found once it's there */
 
 	size_t total, i = 0;
 	fseek(f, 0, SEEK_END);
 	total = ftell(f);
 	fseek(f, 0, SEEK_SET);
 
+	buf->reserve(total);
 	char cbuf[4098];
 	while(i != total)
 	{
-		size_t r = fread(cbuf, 1, sizeof(buf), f);
-		buf += std::string(cbuf, r);
+		size_t r = fread(cbuf, 1, sizeof(cbuf), f);
+		if(r == 0) break;
+		buf->append(cbuf, r);
 		i += r;
 	}
 
 	fclose(f);
-	file_cache[this->path] = buf;
+	LightLock_Lock(&file_cache_lock);
+	file_cache_insert(this->path, buf);
+	LightLock_Unlock(&file_cache_lock);
+	return buf;
+}
+
+static const char *content_type(const std::string& path)
+{
+	std::string::size_type dot = path.rfind('.');
+	if(dot == std::string::npos) return nullptr;
+	std::string ext = path.substr(dot + 1);
+	if(ext == "html") return "text/html; charset=utf-8";
+	if(ext == "css")  return "text/css; charset=utf-8";
+	if(ext == "js")   return "text/javascript; charset=utf-8";
+	if(ext == "svg")  return "image/svg+xml";
+	if(ext == "txt")  return "text/plain; charset=utf-8";
+	if(ext == "png")  return "image/png";
+	if(ext == "json") return "application/json";
+	return nullptr;
+}
+
+/* returns true if gzip is in an Accept-Encoding list without q=0 */
+static bool accepts_gzip(const std::string& list)
+{
+	std::string::size_type begin = 0, end;
+	do {
+		end = list.find(',', begin);
+		std::string enc = list.substr(begin, end == std::string::npos ? std::string::npos : end - begin);
+		begin = end + 1;
+
+		std::string::size_type semi = enc.find(';');
+		std::string name = enc.substr(0, semi);
+		trim(name, " \t");
+		lower(name);
+		if(name != "gzip" && name != "*")
+			continue;
+		if(semi == std::string::npos)
+			return true;
+		std::string param = enc.substr(semi + 1);
+		trim(param, " \t");
+		/* q=0, q=0.0 and so on mean "not acceptable" */
+		return !(param.compare(0, 2, "q=") == 0 && strtod(param.c_str() + 2, nullptr) == 0.0);
+	} while(end != std::string::npos);
+	return false;
 }
 
 void hlink::HTTPRequestContext::serve_plain()
 {
-	this->serve_file(200, this->server->root + this->path, { });
+	auto it = this->server->files.find(this->path);
+	if(it == this->server->files.end())
+	{
+		this->serve_file(200, this->server->root + this->path, { });
+		return;
+	}
+
+	HTTPHeaders headers;
+	const char *type = content_type(this->path);
+	if(type) headers["Content-Type"] = type;
+	if(it->second.gzipped)
+	{
+		/* caches must not hand the gzip copy to clients that can't decode it */
+		headers["Vary"] = "Accept-Encoding";
+		auto enc = this->headers.find("accept-encoding");
+		if(enc != this->headers.end() && accepts_gzip(enc->second))
+		{
+			auto gz = this->server->files.find(this->path + ".gz"); /* gzipped says it's there */
+			headers["Content-Encoding"] = "gzip";
+			this->serve_static(gz->second, this->server->root + gz->first, headers);
+			return;
+		}
+	}
+	this->serve_static(it->second, this->server->root + this->path, headers);
 }
 
 static bool isdir(const std::string& str)
@@ -537,29 +868,35 @@ int hlink::HTTPServer::make_reqctx(HTTPRequestContext& ctx)
 {
 	panic_assert(this->fd != -1, "Tried to make a request on an unbound context");
 	ctx.server = this;
+	ctx.keepalive = false;
 	ctx.iseof = false;
 	ctx.buflen = 0;
+	ctx.skip = 0;
 
-	ssize_t len;
 	memset(&ctx.clientaddr, 0x0, sizeof(ctx.clientaddr));
 	socklen_t clientaddr_len = sizeof(ctx.clientaddr);
 	if((ctx.fd = accept(this->fd, (struct sockaddr *) &ctx.clientaddr, &clientaddr_len)) < 0)
 		return errno;
+	/* a file is sent in more than one piece, the last one mustn't wait for the client to
+	 * acknowledge the others. on a persistent connection that stalls every response */
+	int nodelay = 1;
+	setsockopt(ctx.fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+	return 0;
+}
 
-	if((len = recv(ctx.fd, ctx.buf, sizeof(ctx.buf), 0)) < 0)
-	{ ctx.serve_400(); ctx.close(); return errno; }
-	ctx.buflen = len;
-
+/* returns 0 on success, -1 on error, the whole head must be in the buffer */
+static int parse_reqctx(HTTPRequestContext& ctx)
+{
 	ssize_t of;
 	if((of = bufstrchrof(ctx.buf, ctx.buflen, ' ')) < 1)
-	{ ctx.serve_400(); ctx.close(); return -1; }
+		return -1;
 
 	ctx.method = std::string(ctx.buf, of);
 	realize_offset(ctx, of + 1);
 	lower(ctx.method);
 
 	if((of = bufstrchrof(ctx.buf, ctx.buflen, ' ')) < 1)
-	{ ctx.serve_400(); ctx.close(); return -1; }
+		return -1;
 
 	ctx.path = std::string(ctx.buf, of);
 	realize_offset(ctx, of + 1);
@@ -567,32 +904,100 @@ int hlink::HTTPServer::make_reqctx(HTTPRequestContext& ctx)
 	parse_url_params(ctx.path, ctx.params);
 
 	if((of = bufstrnlof(ctx.buf, ctx.buflen)) < 1)
-	{ ctx.serve_400(); ctx.close(); return -1; }
-	/* we don't care about the version */
+		return -1;
+	/* HTTP/1.1 connections are persistent unless asked otherwise */
+	ctx.keepalive = std::string(ctx.buf, of) == "HTTP/1.1";
 	realize_offset(ctx, of + bufnllen(ctx.buf + of, ctx.buflen - of));
 
 	vlog("(HTTP) Parsed request line; method=%s,path=%s", ctx.method.c_str(), ctx.path.c_str());
 
 	/* parse headers */
 	int res;
-	while(true)
+	while((res = parse_header(ctx)) == 2) continue; /* while parse_success */
+	if(res != 0) return -1; /* need_more_data can't happen with a complete head */
+
+	auto it = ctx.headers.find("connection");
+	if(it != ctx.headers.end())
 	{
-		while((res = parse_header(ctx)) == 2) continue; /* while parse_success */
-		if(ctx.iseof) res = -1;
-		if(res != 1) break; /* if not need_more_data */ 
-
-		/* refill buffer */
-		if((len = recv(ctx.fd, ctx.buf + ctx.buflen, sizeof(ctx.buf) - ctx.buflen, 0)) < 0)
-		{ ctx.serve_400(); ctx.close(); return errno; }
-		ctx.iseof = len == 0;
-		ctx.buflen += len;
+		std::string conn = it->second;
+		lower(conn);
+		if(conn == "close") ctx.keepalive = false;
+		else if(conn == "keep-alive") ctx.keepalive = true;
 	}
+	return 0;
+}
 
-	if(res != 0)
+int hlink::HTTPServer::feed_reqctx(HTTPRequestContext& ctx)
+{
+	panic_assert(ctx.fd != -1, "tried to feed an unbound context");
+	/* the rest of the previous body comes first, nothing is buffered until it's gone */
+	char *dst = ctx.skip != 0 ? ctx.buf : ctx.buf + ctx.buflen;
+	size_t max = ctx.skip != 0 ? std::min(ctx.skip, sizeof(ctx.buf)) : sizeof(ctx.buf) - ctx.buflen;
+	ssize_t len;
+	if((len = recv(ctx.fd, dst, max, 0)) <= 0)
+	{
+		/* the client went away before sending a complete request */
+		ctx.iseof = true;
+		ctx.close();
+		return -1;
+	}
+	if(ctx.skip != 0)
 	{
+		ctx.skip -= len;
+		return 1;
+	}
+	ctx.buflen += len;
+	return this->take_reqctx(ctx);
+}
+
+int hlink::HTTPServer::take_reqctx(HTTPRequestContext& ctx)
+{
+	if(ctx.skip != 0)
+		return 1; /* the previous body isn't dropped yet */
+	/* we only parse once we have the whole head so a slow client can't make us block */
+	if(bufstrstr(ctx.buf, ctx.buflen, "\r\n\r\n") == nullptr
+		&& bufstrstr(ctx.buf, ctx.buflen, "\n\n") == nullptr)
+	{
+		if(ctx.buflen != sizeof(ctx.buf))
+			return 1; /* need more data */
+		ctx.keepalive = false;
+		ctx.respond(431, "", { });
+		ctx.close();
+		return -1;
+	}
+
+	if(parse_reqctx(ctx) != 0)
+	{
+		ctx.keepalive = false;
 		ctx.serve_400();
 		ctx.close();
+		return -1;
 	}
-	return res; /* eof before parse_header() = bad */
+	return 0;
 }
 
+bool hlink::HTTPRequestContext::next_request()
+{
+	/* we don't know where a chunked body ends without reading it */
+	if(this->headers.count("transfer-encoding") != 0)
+		return false;
+
+	/* handlers never read the body so all of it is still there, it may
+	 * already be partly in the buffer along with the next request. the rest
+	 * is dropped by feed_reqctx() in the event loop, a handler must not block on it */
+	size_t left = 0;
+	auto it = this->headers.find("content-length");
+	if(it != this->headers.end())
+		left = strtoul(it->second.c_str(), nullptr, 10);
+	if(left > hlink::max_skipped_body)
+		return false;
+	size_t inbuf = left < this->buflen ? left : this->buflen;
+	realize_offset(*this, inbuf);
+	this->skip = left - inbuf;
+
+	this->headers.clear();
+	this->params.clear();
+	this->method.clear();
+	this->path.clear();
+	return true;
+}
@@ -15,6 +15,8 @@
  */
 
 #include "update.hh" /* includes net constants */
+#include "netcache.hh"
+#include "thread.hh"
 #include "hsapi.hh"
 #include "error.hh"
 #include "proxy.hh"
@@ -22,12 +24,21 @@
 #include "log.hh"
 
 #include <3rd/json.hh>
+#include <unordered_set>
 #include <algorithm>
 #include <malloc.h>
 
 #define SOC_ALIGN       0x100000
 #define SOC_BUFFERSIZE  0x20000
 
+/* amount of data received per httpcDownloadData() call in basereq(), cancellation
+ * is checked after every call so this also bounds how late a cancel is noticed */
+#ifndef API_READ_SIZE
+	#define API_READ_SIZE 0x10000
+#endif
+/* only log this much of every response */
+#define API_LOG_MAX     0x1000
+
 #if defined(HS_DEBUG_SERVER)
 	#define HS_BASE_LOC HS_DEBUG_SERVER ":5000/api"
 	#define HS_CDN_BASE HS_DEBUG_SERVER ":5001"
@@ -64,7 +75,26 @@ extern "C" const char *hsapi_user;             /* hsapi_auth.c */
 
 using json = nlohmann::json;
 
+/* libctru contexts only do a single request, but the http sysmodule may keep the connection
+ * of a context that is closed without cancelling it around for the next context to the
+ * same host. we can't see if it does, so we only count how many requests started within
+ * KEEPALIVE_MS of the previous one to the same host finishing, where reuse is possible */
+#define KEEPALIVE_MS 15000
+
+static std::unordered_map<std::string, u64> g_liveconns; /* host -> when its last request finished */
+static u32 g_connwarm = 0, g_conncold = 0; /* requests within/outside of the keep-alive window */
+static LightLock g_connlock;
+static char *g_password = nullptr;
+/* set by hsapi::background_scope, requests on such threads never read input and are only
+ * cancelled through t_cancelled, see hsapi::pending::cancel() */
+static thread_local volatile bool *t_cancelled = nullptr;
+static thread_local bool t_background = false;
+
 static u32 *g_socbuf = nullptr;
+static ctr::thread<> *g_indexRefresher = nullptr;
+static volatile bool g_indexRefreshStop = false;
+/* the refresher and fetch_index() may both write the snapshot */
+static LightLock g_snapshotLock;
 static hsapi::Index g_index;
 #ifndef RELEASE
 static bool g_indexLoaded = false;
@@ -79,15 +109,44 @@ hsapi::Index *hsapi::get_index()
 }
 
 
+static void init_interned();
+static void init_prefetcher();
+static void stop_prefetcher();
+static void init_async_workers();
+static void stop_async_workers();
+
 void hsapi::global_deinit()
 {
+	/* the refresher, prefetcher and async workers may still be using the network */
+	g_indexRefreshStop = true;
+	delete g_indexRefresher;
+	stop_prefetcher();
+	stop_async_workers();
 	socExit();
 	if(g_socbuf != NULL)
 		free(g_socbuf);
+	if(g_password != NULL)
+	{
+		memset(g_password, 0, hsapi_password_length);
+		free(g_password);
+	}
+	ilog("api requests: %lu within keep-alive window, %lu outside", g_connwarm, g_conncold);
 }
 
 bool hsapi::global_init()
 {
+	LightLock_Init(&g_connlock);
+	LightLock_Init(&g_snapshotLock);
+	init_interned();
+	init_async_workers();
+	init_prefetcher();
+	netcache::init();
+	/* decoding it for every request is a waste */
+	if(!(g_password = (char *) malloc(hsapi_password_length + 1)))
+		return false;
+	hsapi_password(g_password);
+	g_password[hsapi_password_length] = '\0';
+
 	if(!(g_socbuf = (u32 *) memalign(SOC_ALIGN, SOC_BUFFERSIZE)))
 	{
 		elog("failed to allocate buffer of %X (aligned %X) for SOC", SOC_BUFFERSIZE, SOC_ALIGN);
@@ -101,17 +160,73 @@ bool hsapi::global_init()
 	return true;
 }
 
-static Result basereq(const std::string& url, std::string& data, HTTPC_RequestMethod reqmeth = HTTPC_METHOD_GET, const char *postdata = nullptr, u32 postdata_len = 0)
+static std::string url_host(const std::string& url)
+{
+	std::string::size_type start = url.find("://");
+	start = start == std::string::npos ? 0 : start + 3;
+	return url.substr(start, url.find('/', start) - start);
+}
+
+/* marks a request to host as started, counts if the previous one finished within the keep-alive window */
+static void conn_acquire(const std::string& host)
+{
+	LightLock_Lock(&g_connlock);
+	std::unordered_map<std::string, u64>::iterator it = g_liveconns.find(host);
+	bool warm = it != g_liveconns.end() && osGetTime() - it->second < KEEPALIVE_MS;
+	if(it != g_liveconns.end()) g_liveconns.erase(it);
+	if(warm) ++g_connwarm;
+	else     ++g_conncold;
+	dlog("request to %s, %s keep-alive window (within=%lu, outside=%lu)", host.c_str(),
+		warm ? "within" : "outside of", g_connwarm, g_conncold);
+	LightLock_Unlock(&g_connlock);
+}
+
+/* marks the last request to host as finished with a connection that may be kept alive */
+static void conn_release(const std::string& host)
+{
+	LightLock_Lock(&g_connlock);
+	g_liveconns[host] = osGetTime();
+	LightLock_Unlock(&g_connlock);
+}
+
+hsapi::background_scope::background_scope(volatile bool *cancel)
+	: prevCancel(t_cancelled), prevBackground(t_background)
+{
+	t_cancelled = cancel;
+	t_background = true;
+}
+
+hsapi::background_scope::~background_scope()
+{
+	t_cancelled = this->prevCancel;
+	t_background = this->prevBackground;
+}
+
+/* only the ui thread may look at the keys, hidScanInput() and the SELECT menu aren't thread safe */
+static bool request_cancelled()
 {
-	u32 dled = 0, status = 0, totalSize = 0;
+	if(t_cancelled && *t_cancelled)
+		return true;
+	if(t_background)
+		return false;
+	ui::Keys k = ui::RenderQueue::get_keys();
+	return (k.kDown | k.kHeld) & (KEY_B | KEY_START);
+}
+
+/* if cache is set the response is cached, and if cache holds an earlier response it's revalidated.
+ * the cache entry is that of cacheurl, which is url unless we were redirected */
+static Result basereq(const std::string& url, std::string& data, HTTPC_RequestMethod reqmeth = HTTPC_METHOD_GET, const char *postdata = nullptr, u32 postdata_len = 0, netcache::entry *cache = nullptr, const std::string *cacheurl = nullptr)
+{
+	if(!cacheurl) cacheurl = &url;
+	u32 dled = 0, status = 0, totalSize = 0, size = 0, toread;
 	std::string redir;
+	std::string host = url_host(url);
 	char buffer[4096];
 	httpcContext ctx;
 	Result res = OK;
-	char *password;
-	ui::Keys k;
 
 #define TRY(expr) if(R_FAILED(res = ( expr ) )) goto out
+	conn_acquire(host);
 	if(R_FAILED(res = httpcOpenContext(&ctx, reqmeth, url.c_str(), 0)))
 		return res;
 	TRY(httpcSetSSLOpt(&ctx, SSLCOPT_DisableVerify));
@@ -119,19 +234,42 @@ static Result basereq(const std::string& url, std::string& data, HTTPC_RequestMe
 	TRY(httpcAddRequestHeaderField(&ctx, "Connection", "Keep-Alive"));
 	TRY(httpcAddRequestHeaderField(&ctx, "User-Agent", USER_AGENT));
 	TRY(httpcAddRequestHeaderField(&ctx, "X-Auth-User", hsapi_user));
-/*TRY(httpcAddRequestHeaderField(&ctx, "X-Auth-Password", password));*/password=(char*)malloc(hsapi_password_length+1);hsapi_password(password);password[hsapi_password_length]=0;TRY(httpcAddRequestHeaderField(&ctx,"X-Auth-Password",password));memset(password,0,hsapi_password_length);free(password);
+	TRY(httpcAddRequestHeaderField(&ctx, "X-Auth-Password", g_password));
 	if(hscert_der_len && url.find("https") == 0) // only use certs on https
 		TRY(httpcAddTrustedRootCA(&ctx, hscert_der, hscert_der_len));
 	if(postdata && postdata_len != 0)
 		/* for some reason postdata is a u32 instead of u8.... */
 		TRY(httpcAddPostDataRaw(&ctx, (const u32 *) postdata, postdata_len));
 	TRY(proxy::apply(&ctx));
+	if(cache && cache->fetched != 0)
+	{
+		if(cache->etag.size() != 0)
+			TRY(httpcAddRequestHeaderField(&ctx, "If-None-Match", cache->etag.c_str()));
+		if(cache->lastmod.size() != 0)
+			TRY(httpcAddRequestHeaderField(&ctx, "If-Modified-Since", cache->lastmod.c_str()));
+	}
 
+	/* the request may have gone stale while it was waiting for a connection */
+	if(request_cancelled())
+	{
+		res = APPERR_CANCELLED;
+		goto out;
+	}
 	TRY(httpcBeginRequest(&ctx));
 
 	TRY(httpcGetResponseStatusCode(&ctx, &status));
 	vlog("API status code on %s: %lu", url.c_str(), status);
 
+	// Is what we have cached still valid?
+	if(status == 304 && cache && cache->fetched != 0)
+	{
+		httpcCloseContext(&ctx);
+		conn_release(host);
+		netcache::revalidated(*cacheurl, *cache);
+		data.swap(cache->body);
+		return OK;
+	}
+
 	// Do we want to redirect?
 	if(status / 100 == 3)
 	{
@@ -141,7 +279,7 @@ static Result basereq(const std::string& url, std::string& data, HTTPC_RequestMe
 		vlog("Redirected to %s", redir.c_str());
 		httpcCancelConnection(&ctx);
 		httpcCloseContext(&ctx);
-		return basereq(redir, data, reqmeth);
+		return basereq(redir, data, reqmeth, nullptr, 0, cache, cacheurl);
 	}
 
 	if(status != 200)
@@ -167,20 +305,43 @@ static Result basereq(const std::string& url, std::string& data, HTTPC_RequestMe
 	}
 
 	TRY(httpcGetDownloadSizeState(&ctx, nullptr, &totalSize));
-	if(totalSize != 0) data.reserve(totalSize);
+	/* we receive straight into data, so it has to be resized instead of reserved */
+	data.resize(totalSize != 0 ? totalSize : API_READ_SIZE);
 
 	do {
-		res = httpcDownloadData(&ctx, (unsigned char *) buffer, sizeof(buffer), &dled);
-		k = ui::RenderQueue::get_keys();
-		if(R_SUCCEEDED(res) && ((k.kDown | k.kHeld) & (KEY_B | KEY_START)))
-			res = APPERR_CANCELLED;
+		/* the size is unknown or the server sent more than it said it would */
+		if(size == data.size())
+			data.resize(data.size() * 2);
+		toread = data.size() - size < API_READ_SIZE ? data.size() - size : API_READ_SIZE;
+		res = httpcDownloadData(&ctx, (unsigned char *) &data[size], toread, &dled);
+		size += dled;
 		// Other type of fail
 		if(R_FAILED(res) && res != (Result) HTTPC_RESULTCODE_DOWNLOADPENDING)
 			goto out;
-		data += std::string(buffer, dled);
+		/* checked after every chunk, not only once everything is received */
+		if(request_cancelled())
+		{
+			res = APPERR_CANCELLED;
+			goto out;
+		}
 	} while(res == (Result) HTTPC_RESULTCODE_DOWNLOADPENDING);
+	data.resize(size);
 
-	vlog("API data gotten:\n%s", data.c_str());
+	vlog("API data gotten (%lu bytes):\n%.*s", size, API_LOG_MAX, data.c_str());
+	if(cache)
+	{
+		cache->etag = R_SUCCEEDED(httpcGetResponseHeader(&ctx, "ETag", buffer, sizeof(buffer))) ? buffer : "";
+		cache->lastmod = R_SUCCEEDED(httpcGetResponseHeader(&ctx, "Last-Modified", buffer, sizeof(buffer))) ? buffer : "";
+		/* swapped so the body isn't copied */
+		cache->body.swap(data);
+		netcache::store(*cacheurl, *cache);
+		data.swap(cache->body);
+	}
+
+	/* everything is received, so the connection can be kept around */
+	httpcCloseContext(&ctx);
+	conn_release(host);
+	return res;
 
 out:
 	httpcCancelConnection(&ctx);
@@ -207,17 +368,45 @@ static Result api_res_to_rc(json& j)
 	}
 }
 
+template <typename J>
+static Result parse_json(const std::string& data, J& j)
+{
+	j = J::parse(data, nullptr, false);
+	if(j == J::value_t::discarded)
+		return APPERR_JSON_FAIL;
+	return OK;
+}
+
 template <typename J>
 static Result basereq(const std::string& url, J& j, HTTPC_RequestMethod reqmeth = HTTPC_METHOD_GET, const char *postdata = nullptr, u32 postdata_len = 0)
 {
 	std::string data;
 	Result res = basereq(url, data, reqmeth, postdata, postdata_len);
 	if(R_FAILED(res)) return res;
+	return parse_json(data, j);
+}
 
-	j = J::parse(data, nullptr, false);
-	if(j == J::value_t::discarded)
-		return APPERR_JSON_FAIL;
-	return OK;
+/* like basereq(), but the response may come from or go to the cache in netcache.hh.
+ * with revalidate set the server is always asked, but may still answer that the cached response is current */
+static Result cachedreq(const std::string& url, std::string& data, bool revalidate = false)
+{
+	netcache::entry ent;
+	if(netcache::lookup(url, ent) && !revalidate && netcache::fresh(ent))
+	{
+		data.swap(ent.body);
+		return OK;
+	}
+	return basereq(url, data, HTTPC_METHOD_GET, nullptr, 0, &ent);
+}
+
+template <typename J>
+static Result cachedreq(const std::string& url, J& j, bool revalidate = false)
+{
+	std::string data;
+	Result res;
+	if(R_FAILED(res = cachedreq(url, data, revalidate)))
+		return res;
+	return parse_json(data, j);
 }
 
 static Result serialize_subcategories(std::vector<hsapi::Subcategory>& rscats, const std::string& cat, json& scats)
@@ -263,19 +452,9 @@ static Result serialize_categories(std::vector<hsapi::Category>& rcats, json& ca
 	return OK;
 }
 
-static Result serialize_title(hsapi::Title& t, json& jt)
+/* prefixes the names of virtual console titles with their system */
+static void add_vc_prefix(hsapi::Title& t)
 {
-	TRYGET_SZ(jt, t.size, "size");
-	TRYGET_SZ(jt, t.dlCount, "download_count");
-	TRYGET_ID(jt, t.id, "id");
-	TRYCHECK_S(jt, "title_id");
-	t.tid = ctr::str_to_tid(jt["title_id"].get<std::string>());
-	TRYGET_S(jt, t.cat, "category");
-	TRYGET_S(jt, t.subcat, "subcategory");
-	TRYGET_S(jt, t.name, "name");
-	TRYGET_FLAGS(jt, t.flags, "flags");
-	TRYGETOPT_S(jt, t.alt, "alternative_name");
-
 	const char *vc_type;
 	switch((t.flags >> hsapi::VCType::shift) & hsapi::VCType::mask)
 	{
@@ -295,18 +474,22 @@ static Result serialize_title(hsapi::Title& t, json& jt)
 		if(t.alt.size()) t.alt = vc_type + t.alt;
 		t.name = vc_type + t.name;
 	}
-	return OK;
 }
 
-static Result serialize_titles(std::vector<hsapi::Title>& rtitles, json& j)
+static Result serialize_title(hsapi::Title& t, json& jt)
 {
-	for(json::iterator it = j.begin(); it != j.end(); ++it)
-		if(CHECK_BOOL(it.value(), "is_listed") && it.value()["is_listed"].get<bool>())
-		{
-			rtitles.emplace_back();
-			if(serialize_title(rtitles.back(), it.value()) != OK)
-				return APPERR_JSON_FAIL;
-		}
+	TRYGET_SZ(jt, t.size, "size");
+	TRYGET_SZ(jt, t.dlCount, "download_count");
+	TRYGET_ID(jt, t.id, "id");
+	TRYCHECK_S(jt, "title_id");
+	t.tid = ctr::str_to_tid(jt["title_id"].get<std::string>());
+	TRYGET_S(jt, t.cat, "category");
+	TRYGET_S(jt, t.subcat, "subcategory");
+	TRYGET_S(jt, t.name, "name");
+	TRYGET_FLAGS(jt, t.flags, "flags");
+	TRYGETOPT_S(jt, t.alt, "alternative_name");
+
+	add_vc_prefix(t);
 	return OK;
 }
 
@@ -322,16 +505,354 @@ static Result serialize_full_title(hsapi::FullTitle& ret, json& j)
 	return OK;
 }
 
-static Result serialize_full_titles(std::vector<hsapi::FullTitle>& rtitles, json& j)
+/* title listings can be large, so instead of building a json document and copying
+ * it into titles these are filled while the response is parsed. the validation is
+ * the same as serialize_title() and serialize_full_title() do on a document.
+ * the value is either an array of titles, or with batch set an object of title id
+ * keys with arrays of titles */
+template <typename T>
+class title_sax
 {
-	for(json::iterator it = j.begin(); it != j.end(); ++it)
-		if(CHECK_BOOL(it.value(), "is_listed") && it.value()["is_listed"].get<bool>())
+public:
+	title_sax(std::vector<T> *list) : list(list), batch(nullptr) { }
+	title_sax(hsapi::BatchRelated *batch) : list(nullptr), batch(batch) { }
+
+	Result parse(const std::string& data)
+	{
+		if(!json::sax_parse(data, this))
+			return APPERR_JSON_FAIL;
+		if(!this->hasCode) { elog("Prop: code"); return APPERR_JSON_FAIL; }
+		if(this->code != 0)
 		{
-			rtitles.emplace_back();
-			if(serialize_full_title(rtitles.back(), it.value()) != OK)
-				return APPERR_JSON_FAIL;
+			if(!this->hasError) { elog("Prop: error_message"); return APPERR_JSON_FAIL; }
+			elog("API Error: %s (%08lX)", this->error.c_str(), this->code);
+			return APPERR_API_FAIL;
 		}
-	return OK;
+		if(!this->hasValue) { elog("Prop: value"); return APPERR_JSON_FAIL; }
+		return this->res;
+	}
+
+	bool null() { return this->scalar(kind_other); }
+	bool boolean(bool val) { this->listed = val; return this->scalar(kind_bool); }
+	bool number_integer(json::number_integer_t val) { this->inum = val; return this->scalar(kind_number); }
+	bool number_unsigned(json::number_unsigned_t val) { this->unum = val; return this->scalar(kind_unsigned); }
+	bool number_float(json::number_float_t val, const std::string&) { this->inum = val; return this->scalar(kind_number); }
+	bool binary(json::binary_t&) { return this->scalar(kind_other); }
+	bool string(std::string& val) { this->str = &val; return this->scalar(kind_string); }
+	bool key(std::string& val) { this->key_at(this->depth).swap(val); return true; }
+	bool start_object(std::size_t) { return this->start(true); }
+	bool start_array(std::size_t) { return this->start(false); }
+	bool end_object() { return this->end(); }
+	bool end_array() { return this->end(); }
+
+	bool parse_error(std::size_t pos, const std::string&, const nlohmann::detail::exception&)
+	{
+		elog("failed to parse title listing at byte %u", pos);
+		return false;
+	}
+
+
+private:
+	enum kind { kind_unsigned, kind_number, kind_string, kind_bool, kind_other };
+	enum field
+	{
+		field_size, field_dlcount, field_id, field_tid, field_cat, field_subcat,
+		field_name, field_flags, field_alt, field_prod, field_version, field_seed,
+		field_listed, field_count,
+	};
+
+	typedef struct field_info
+	{
+		const char *name;
+		kind k;
+	} field_info;
+
+	static constexpr u32 MAX_DEPTH = 5;
+	static constexpr bool full = std::is_same<T, hsapi::FullTitle>::value;
+	/* alternative_name and seed are optional, full title fields are only read for hsapi::FullTitle */
+	static constexpr u32 required = 0xFF | (full ? (1 << field_prod) | (1 << field_version) : 0);
+
+	std::vector<T> *list;
+	hsapi::BatchRelated *batch;
+	std::string keys[MAX_DEPTH];
+	std::string *str;
+	std::string error;
+	std::string tid;
+	json::number_unsigned_t unum;
+	json::number_integer_t inum;
+	bool listed;
+	T cur;
+
+	u32 depth = 0, seen = 0, bad = 0;
+	Result code, res = OK;
+	bool hasCode = false, hasError = false, hasValue = false;
+	bool inStatus = false, inValue = false, inTitle = false, isListed = false;
+
+	/* the depth titles are at */
+	u32 title_depth() { return this->batch ? 4 : 3; }
+	/* the last key of the object at depth, deeper objects share the last slot */
+	std::string& key_at(u32 depth) { return this->keys[depth < MAX_DEPTH ? depth : MAX_DEPTH - 1]; }
+	std::string& cur_key() { return this->key_at(this->depth); }
+
+	static const field_info *fields()
+	{
+		static const field_info fields[field_count] = {
+			{ "size", kind_unsigned }, { "download_count", kind_unsigned }, { "id", kind_unsigned },
+			{ "title_id", kind_string }, { "category", kind_string }, { "subcategory", kind_string },
+			{ "name", kind_string }, { "flags", kind_unsigned }, { "alternative_name", kind_string },
+			{ "product_code", kind_string }, { "version", kind_unsigned }, { "seed", kind_string },
+			{ "is_listed", kind_bool },
+		};
+		return fields;
+	}
+
+	static int title_field(const std::string& key, kind& k)
+	{
+		for(int i = 0; i < field_count; ++i)
+			if(key == fields()[i].name)
+			{
+				k = fields()[i].k;
+				return i;
+			}
+		return -1;
+	}
+
+	static void set_full_field(hsapi::Title&, int, std::string&, json::number_unsigned_t) { }
+	static void set_full_field(hsapi::FullTitle& t, int f, std::string& str, json::number_unsigned_t num)
+	{
+		switch(f)
+		{
+		case field_prod:    t.prod.swap(str); break;
+		case field_version: t.version = num; break;
+		case field_seed:    t.seed.swap(str); break;
+		}
+	}
+
+	/* batches only hold full titles */
+	static std::vector<hsapi::Title> *related_list(hsapi::BatchRelated *, const std::string&, hsapi::Title *) { return nullptr; }
+	static std::vector<hsapi::FullTitle> *related_list(hsapi::BatchRelated *batch, const std::string& tid, hsapi::FullTitle *)
+	{ return &(*batch)[ctr::str_to_tid(tid)]; }
+
+	void set_field(int f)
+	{
+		switch(f)
+		{
+		case field_size:    this->cur.size = this->unum; break;
+		case field_dlcount: this->cur.dlCount = this->unum; break;
+		case field_id:      this->cur.id = this->unum; break;
+		case field_tid:     this->tid.swap(*this->str); break;
+		case field_cat:     this->cur.cat = *this->str; break;
+		case field_subcat:  this->cur.subcat = *this->str; break;
+		case field_name:    this->cur.name.swap(*this->str); break;
+		case field_flags:   this->cur.flags = this->unum; break;
+		case field_alt:     this->cur.alt.swap(*this->str); break;
+		case field_listed:  this->isListed = this->listed; break;
+		default:            set_full_field(this->cur, f, *this->str, this->unum); break;
+		}
+	}
+
+	/* a value in a title that isn't an object or array */
+	void title_value(kind k)
+	{
+		kind want;
+		int f = title_field(this->cur_key(), want);
+		if(f < 0 || (!full && f >= field_prod && f != field_listed))
+			return;
+		if(k == want)
+		{
+			this->seen |= 1 << f;
+			this->bad &= ~(1 << f);
+			this->set_field(f);
+		}
+		else this->bad |= 1 << f;
+	}
+
+	bool scalar(kind k)
+	{
+		if(this->inTitle && this->depth == this->title_depth())
+			this->title_value(k);
+		else if(this->inStatus && this->depth == 2 && this->cur_key() == "code")
+		{
+			this->hasCode = k == kind_unsigned || k == kind_number;
+			this->code = k == kind_unsigned ? this->unum : this->inum;
+		}
+		else if(this->depth == 1 && this->cur_key() == "error_message")
+		{
+			if((this->hasError = k == kind_string))
+				this->error.swap(*this->str);
+		}
+		return true;
+	}
+
+	bool start(bool object)
+	{
+		/* objects and arrays are never valid title fields */
+		if(this->inTitle && this->depth == this->title_depth())
+			this->title_value(kind_other);
+		const std::string& parentkey = this->cur_key();
+		++this->depth;
+
+		if(this->depth == 2 && object && parentkey == "status")
+			this->inStatus = true;
+		else if(this->depth == 2 && parentkey == "value")
+			this->inValue = this->hasValue = object == (this->batch != nullptr);
+		else if(this->inValue && this->batch && this->depth == 3 && !object)
+			this->list = related_list(this->batch, parentkey, &this->cur);
+		else if(this->inValue && this->depth == this->title_depth() && object && this->list)
+		{
+			this->inTitle = true;
+			this->isListed = false;
+			this->seen = this->bad = 0;
+			this->cur = T();
+		}
+		return true;
+	}
+
+	bool end()
+	{
+		if(this->inTitle && this->depth == this->title_depth())
+		{
+			this->inTitle = false;
+			this->finish_title();
+		}
+		else if(this->depth == 3 && this->batch)
+			this->list = nullptr;
+		else if(this->depth == 2)
+			this->inStatus = this->inValue = false;
+		--this->depth;
+		return true;
+	}
+
+	void finish_title()
+	{
+		/* unlisted titles are skipped without looking at them, like serialize_titles() did */
+		if(!(this->seen & (1 << field_listed)) || !this->isListed || this->res != OK)
+			return;
+		u32 missing = (~this->seen & required) | (this->bad & ~(1 << field_listed));
+		if(missing)
+		{
+			for(int i = 0; i < field_count; ++i)
+				if(missing & (1 << i))
+				{
+					elog("Prop: %s", fields()[i].name);
+					break;
+				}
+			this->res = APPERR_JSON_FAIL;
+			return;
+		}
+		this->cur.tid = ctr::str_to_tid(this->tid);
+		add_vc_prefix(this->cur);
+		this->list->push_back(std::move(this->cur));
+	}
+
+
+};
+
+/* requests made with hsapi::async_call() run on these threads, which are only created once */
+#define ASYNC_WORKERS 2
+
+typedef struct hsapi::detail::async_state
+{
+	std::function<Result()> func;
+	LightEvent finished;
+	volatile bool cancelled;
+	volatile bool done;
+	Result res;
+} async_state;
+
+static std::vector<std::shared_ptr<async_state>> g_asyncQueue;
+static ctr::thread<> *g_asyncWorkers[ASYNC_WORKERS] = { nullptr };
+static LightSemaphore g_asyncPending;
+static LightLock g_asyncLock;
+
+static void async_worker()
+{
+	std::shared_ptr<async_state> state;
+	while(true)
+	{
+		LightSemaphore_Acquire(&g_asyncPending, 1);
+		LightLock_Lock(&g_asyncLock);
+		state = g_asyncQueue.front();
+		g_asyncQueue.erase(g_asyncQueue.begin());
+		LightLock_Unlock(&g_asyncLock);
+		/* a null request tells us to stop */
+		if(!state) break;
+
+		if(state->cancelled)
+			state->res = APPERR_CANCELLED;
+		else
+		{
+			{
+				hsapi::background_scope scope(&state->cancelled);
+				state->res = state->func();
+			}
+			if(state->cancelled && R_SUCCEEDED(state->res))
+				state->res = APPERR_CANCELLED;
+		}
+		state->func = nullptr;
+		state->done = true;
+		LightEvent_Signal(&state->finished);
+		state.reset();
+	}
+}
+
+/* the workers themselves are only started by the first async_call() */
+static void init_async_workers()
+{
+	LightLock_Init(&g_asyncLock);
+}
+
+static void stop_async_workers()
+{
+	if(!g_asyncWorkers[0]) return;
+	LightLock_Lock(&g_asyncLock);
+	for(size_t i = 0; i < ASYNC_WORKERS; ++i)
+		g_asyncQueue.emplace_back();
+	LightLock_Unlock(&g_asyncLock);
+	LightSemaphore_Release(&g_asyncPending, ASYNC_WORKERS);
+	for(size_t i = 0; i < ASYNC_WORKERS; ++i)
+	{
+		delete g_asyncWorkers[i];
+		g_asyncWorkers[i] = nullptr;
+	}
+}
+
+std::shared_ptr<async_state> hsapi::detail::async_submit(std::function<Result()> func)
+{
+	std::shared_ptr<async_state> state = std::make_shared<async_state>();
+	LightEvent_Init(&state->finished, RESET_STICKY);
+	state->func = func;
+	state->cancelled = false;
+	state->done = false;
+	state->res = OK;
+
+	LightLock_Lock(&g_asyncLock);
+	if(!g_asyncWorkers[0])
+	{
+		LightSemaphore_Init(&g_asyncPending, 0, 0x7FFF);
+		for(size_t i = 0; i < ASYNC_WORKERS; ++i)
+			g_asyncWorkers[i] = new ctr::thread<>(async_worker, 1);
+	}
+	g_asyncQueue.push_back(state);
+	LightLock_Unlock(&g_asyncLock);
+	LightSemaphore_Release(&g_asyncPending, 1);
+	return state;
+}
+
+bool hsapi::pending::done()
+{
+	return this->state->done;
+}
+
+Result hsapi::pending::wait()
+{
+	LightEvent_Wait(&this->state->finished);
+	return this->state->res;
+}
+
+void hsapi::pending::cancel()
+{
+	this->state->cancelled = true;
 }
 
 // https://en.wikipedia.org/wiki/Percent-encoding
@@ -377,6 +898,30 @@ static std::string gen_url(const std::string& base, const std::unordered_map<std
 	return ret;
 }
 
+const std::string& hsapi::hcat::empty_name()
+{
+	static const std::string empty;
+	return empty;
+}
+
+/* nodes of an unordered_set don't move, so the pointers stay valid */
+static std::unordered_set<std::string> g_internedNames;
+static LightLock g_internLock;
+
+static void init_interned()
+{
+	LightLock_Init(&g_internLock);
+}
+
+const std::string *hsapi::hcat::intern(const std::string& name)
+{
+	if(name.size() == 0) return &empty_name();
+	LightLock_Lock(&g_internLock);
+	const std::string *ret = &*g_internedNames.insert(name).first;
+	LightLock_Unlock(&g_internLock);
+	return ret;
+}
+
 hsapi::Subcategory *hsapi::Category::find(const std::string& name)
 {
 	for(size_t i = 0; i < this->subcategories.size(); ++i)
@@ -397,27 +942,227 @@ hsapi::Category *hsapi::Index::find(const std::string& name)
 	return nullptr;
 }
 
-Result hsapi::fetch_index()
+/* the index is kept in a snapshot on the SD so it doesn't have to be fetched and parsed
+ * at startup. the snapshot is the header, the category records, the subcategory records
+ * and finally a table of NUL terminated strings records refer to by their offset */
+#define SNAPSHOT_PATH    "/3ds/3hs/index.bin"
+#define SNAPSHOT_VERSION 1
+
+typedef struct snapshot_header
 {
-#ifndef RELEASE
-	if(g_indexLoaded) return OK;
-#endif
+	char magic[4]; // "3HSI"
+	u32 version;
+	u64 titles;
+	u64 size;
+	u32 ncats;
+	u32 nscats;
+	u32 strtabsize;
+	u32 reserved;
+} snapshot_header;
+
+typedef struct snapshot_category
+{
+	u32 disp, name, desc; /* string table offsets */
+	u32 prio;
+	u64 titles;
+	u64 size;
+	u32 firstsub, nsubs; /* range in the subcategory records */
+} snapshot_category;
+
+typedef struct snapshot_subcategory
+{
+	u32 disp, name, desc; /* string table offsets */
+	u32 reserved;
+	u64 titles;
+	u64 size;
+} snapshot_subcategory;
+
+static u32 snapshot_string(std::string& strtab, const std::string& str)
+{
+	u32 ret = strtab.size();
+	strtab.append(str.c_str(), str.size() + 1);
+	return ret;
+}
+
+static void write_snapshot(const hsapi::Index& index)
+{
+	std::vector<snapshot_subcategory> scats;
+	std::vector<snapshot_category> cats;
+	snapshot_header header;
+	std::string strtab;
+	FILE *f;
+
+	cats.reserve(index.categories.size());
+	for(const hsapi::Category& cat : index.categories)
+	{
+		cats.push_back({ snapshot_string(strtab, cat.disp), snapshot_string(strtab, cat.name),
+			snapshot_string(strtab, cat.desc), cat.prio, cat.titles, cat.size,
+			(u32) scats.size(), (u32) cat.subcategories.size() });
+		for(const hsapi::Subcategory& scat : cat.subcategories)
+			scats.push_back({ snapshot_string(strtab, scat.disp), snapshot_string(strtab, scat.name),
+				snapshot_string(strtab, scat.desc), 0, scat.titles, scat.size });
+	}
+
+	memcpy(header.magic, "3HSI", 4);
+	header.version = SNAPSHOT_VERSION;
+	header.titles = index.titles;
+	header.size = index.size;
+	header.ncats = cats.size();
+	header.nscats = scats.size();
+	header.strtabsize = strtab.size();
+	header.reserved = 0;
+
+	/* written to a temporary file first so a snapshot is never half written */
+	LightLock_Lock(&g_snapshotLock);
+	if(!(f = fopen(SNAPSHOT_PATH ".tmp", "wb")))
+	{
+		LightLock_Unlock(&g_snapshotLock);
+		return;
+	}
+	bool ok = fwrite(&header, sizeof(header), 1, f) == 1
+		&& (cats.size() == 0 || fwrite(cats.data(), sizeof(snapshot_category), cats.size(), f) == cats.size())
+		&& (scats.size() == 0 || fwrite(scats.data(), sizeof(snapshot_subcategory), scats.size(), f) == scats.size())
+		&& fwrite(strtab.data(), strtab.size(), 1, f) == 1;
+	fclose(f);
+	if(!ok)
+	{
+		elog("failed to write index snapshot");
+		remove(SNAPSHOT_PATH ".tmp");
+		LightLock_Unlock(&g_snapshotLock);
+		return;
+	}
+	remove(SNAPSHOT_PATH);
+	rename(SNAPSHOT_PATH ".tmp", SNAPSHOT_PATH);
+	LightLock_Unlock(&g_snapshotLock);
+	ilog("wrote index snapshot of 0x%X bytes", sizeof(header) + cats.size() * sizeof(snapshot_category)
+		+ scats.size() * sizeof(snapshot_subcategory) + strtab.size());
+}
 
+/* reads the snapshot in one go and fills index from it */
+static bool read_snapshot(hsapi::Index& index)
+{
+	snapshot_subcategory *scats;
+	snapshot_category *cats;
+	snapshot_header *header;
+	const char *strtab;
+	bool ret = false;
+	u8 *snapshot;
+	long size;
+	FILE *f;
+
+	if(!(f = fopen(SNAPSHOT_PATH, "rb")))
+		return false;
+	if(fseek(f, 0, SEEK_END) != 0 || (size = ftell(f)) < (long) sizeof(snapshot_header) || fseek(f, 0, SEEK_SET) != 0
+		|| !(snapshot = (u8 *) malloc(size)))
+	{
+		fclose(f);
+		return false;
+	}
+	if(fread(snapshot, size, 1, f) != 1)
+		goto out;
+
+	header = (snapshot_header *) snapshot;
+	if(memcmp(header->magic, "3HSI", 4) != 0 || header->version != SNAPSHOT_VERSION
+		|| (u64) size != sizeof(snapshot_header) + (u64) header->ncats * sizeof(snapshot_category)
+			+ (u64) header->nscats * sizeof(snapshot_subcategory) + header->strtabsize
+		|| header->strtabsize == 0)
+		goto out;
+	cats = (snapshot_category *) (snapshot + sizeof(snapshot_header));
+	scats = (snapshot_subcategory *) (cats + header->ncats);
+	strtab = (const char *) (scats + header->nscats);
+	if(strtab[header->strtabsize - 1] != '\0')
+		goto out;
+
+#define STR(off) ((off) < header->strtabsize ? strtab + (off) : "")
+	index.categories.clear();
+	index.categories.resize(header->ncats);
+	for(u32 i = 0; i < header->ncats; ++i)
+	{
+		snapshot_category& scat = cats[i];
+		hsapi::Category& cat = index.categories[i];
+		if(scat.firstsub > header->nscats || scat.nsubs > header->nscats - scat.firstsub)
+			goto out;
+		cat.disp = STR(scat.disp);
+		cat.name = STR(scat.name);
+		cat.desc = STR(scat.desc);
+		cat.prio = scat.prio;
+		cat.titles = scat.titles;
+		cat.size = scat.size;
+		cat.subcategories.resize(scat.nsubs);
+		for(u32 j = 0; j < scat.nsubs; ++j)
+		{
+			snapshot_subcategory& ssub = scats[scat.firstsub + j];
+			hsapi::Subcategory& sub = cat.subcategories[j];
+			sub.disp = STR(ssub.disp);
+			sub.name = STR(ssub.name);
+			sub.desc = STR(ssub.desc);
+			sub.titles = ssub.titles;
+			sub.size = ssub.size;
+			sub.cat = cat.name;
+		}
+	}
+#undef STR
+	index.titles = header->titles;
+	index.size = header->size;
+	ret = true;
+
+out:
+	if(!ret) elog("index snapshot is invalid");
+	free(snapshot);
+	fclose(f);
+	return ret;
+}
+
+static Result fetch_index_json(hsapi::Index& index, bool revalidate = false)
+{
 	ilog("calling api");
 	json j;
 	Result res;
-	if(R_FAILED(res = basereq<json>(HS_BASE_LOC "/title-index", j)))
+	if(R_FAILED(res = cachedreq<json>(HS_BASE_LOC "/title-index", j, revalidate)))
 		return res;
 	CHECKAPI(OBJ);
 	j = j["value"];
 
-	TRYGET_SZ(j, g_index.titles, "total_content_count");
-	TRYGET_SZ(j, g_index.size, "size");
+	TRYGET_SZ(j, index.titles, "total_content_count");
+	TRYGET_SZ(j, index.size, "size");
 
 	TRYCHECK_OBJ(j, "entries");
-	if(serialize_categories(g_index.categories, j["entries"]) != OK)
+	if(serialize_categories(index.categories, j["entries"]) != OK)
 		return APPERR_JSON_FAIL;
-	std::sort(g_index.categories.begin(), g_index.categories.end());
+	std::sort(index.categories.begin(), index.categories.end());
+
+	return OK;
+}
+
+/* the snapshot we loaded may be outdated, the fresh one is used the next launch */
+static void refresh_snapshot()
+{
+	hsapi::background_scope scope(&g_indexRefreshStop);
+	hsapi::Index index;
+	/* a cached index may be as old as the snapshot, so the server is always asked */
+	if(R_SUCCEEDED(fetch_index_json(index, true)))
+		write_snapshot(index);
+}
+
+Result hsapi::fetch_index()
+{
+#ifndef RELEASE
+	if(g_indexLoaded) return OK;
+#endif
+
+	Result res;
+	if(g_indexRefresher == nullptr && read_snapshot(g_index))
+	{
+		ilog("loaded index from snapshot");
+		g_indexRefresher = new ctr::thread<>(refresh_snapshot, 1);
+	}
+	else
+	{
+		g_index.categories.clear();
+		if(R_FAILED(res = fetch_index_json(g_index)))
+			return res;
+		write_snapshot(g_index);
+	}
 
 #ifndef RELEASE
 	g_indexLoaded = true;
@@ -426,16 +1171,161 @@ Result hsapi::fetch_index()
 	return OK;
 }
 
+/* subcategory listings the user is likely to open next are fetched in the background
+ * and kept in memory until titles_in() asks for them */
+#ifndef PREFETCH_MAX_SIZE
+	#define PREFETCH_MAX_SIZE 0x100000
+#endif
+
+static std::vector<std::pair<std::string, std::string>> g_prefetched; /* url -> body, oldest first */
+static std::vector<std::string> g_prefetchWanted; /* urls still to fetch, next first */
+static std::string g_prefetchCurrent; /* url being fetched right now */
+static size_t g_prefetchedSize = 0;
+static bool g_prefetchStop = false;
+static volatile bool g_prefetchCancel = false; /* stops the request for g_prefetchCurrent */
+static ctr::thread<> *g_prefetcher = nullptr;
+static LightEvent g_prefetchWake;
+static LightEvent g_prefetchDone; /* signalled when g_prefetchCurrent is cleared */
+static LightLock g_prefetchLock;
+
+static std::string titles_in_url(const std::string& cat, const std::string& scat)
+{
+	return HS_BASE_LOC "/title/category/" + cat + "/" + scat;
+}
+
+static bool is_prefetched(const std::string& url)
+{
+	for(const std::pair<std::string, std::string>& ent : g_prefetched)
+		if(ent.first == url) return true;
+	return false;
+}
+
+static void prefetch_worker()
+{
+	hsapi::background_scope scope(&g_prefetchCancel);
+	std::string url, data;
+	while(true)
+	{
+		LightEvent_Wait(&g_prefetchWake);
+		while(true)
+		{
+			LightLock_Lock(&g_prefetchLock);
+			if(g_prefetchStop || g_prefetchWanted.size() == 0)
+			{
+				LightLock_Unlock(&g_prefetchLock);
+				break;
+			}
+			url = g_prefetchCurrent = g_prefetchWanted.front();
+			g_prefetchWanted.erase(g_prefetchWanted.begin());
+			g_prefetchCancel = false;
+			LightLock_Unlock(&g_prefetchLock);
+
+			/* this also leaves it in the cache on the SD */
+			data.clear();
+			Result res = cachedreq(url, data);
+			if(res == APPERR_CANCELLED) dlog("dropped outdated prefetch of %s", url.c_str());
+			else dlog("prefetched %s: %08lX", url.c_str(), res);
+
+			LightLock_Lock(&g_prefetchLock);
+			if(R_SUCCEEDED(res) && data.size() <= PREFETCH_MAX_SIZE)
+			{
+				while(g_prefetchedSize + data.size() > PREFETCH_MAX_SIZE)
+				{
+					g_prefetchedSize -= g_prefetched.front().second.size();
+					g_prefetched.erase(g_prefetched.begin());
+				}
+				g_prefetchedSize += data.size();
+				g_prefetched.emplace_back(url, std::string());
+				g_prefetched.back().second.swap(data);
+			}
+			g_prefetchCurrent.clear();
+			LightLock_Unlock(&g_prefetchLock);
+			LightEvent_Signal(&g_prefetchDone);
+		}
+		if(g_prefetchStop)
+			break;
+	}
+}
+
+/* the prefetcher itself is only started by the first prefetch_titles_in() */
+static void init_prefetcher()
+{
+	LightLock_Init(&g_prefetchLock);
+}
+
+static void stop_prefetcher()
+{
+	if(!g_prefetcher) return;
+	LightLock_Lock(&g_prefetchLock);
+	g_prefetchStop = true;
+	g_prefetchCancel = true;
+	LightLock_Unlock(&g_prefetchLock);
+	LightEvent_Signal(&g_prefetchWake);
+	delete g_prefetcher;
+	g_prefetcher = nullptr;
+}
+
+/* takes the body of url if it was prefetched, waits if it's being prefetched right now */
+static bool take_prefetched(const std::string& url, std::string& data)
+{
+	LightLock_Lock(&g_prefetchLock);
+	while(g_prefetcher && g_prefetchCurrent == url)
+	{
+		/* a signal for an earlier url doesn't count */
+		LightEvent_Clear(&g_prefetchDone);
+		LightLock_Unlock(&g_prefetchLock);
+		LightEvent_Wait(&g_prefetchDone);
+		LightLock_Lock(&g_prefetchLock);
+	}
+	bool found = false;
+	for(size_t i = 0; i < g_prefetched.size(); ++i)
+		if(g_prefetched[i].first == url)
+		{
+			data.swap(g_prefetched[i].second);
+			g_prefetchedSize -= data.size();
+			g_prefetched.erase(g_prefetched.begin() + i);
+			found = true;
+			break;
+		}
+	LightLock_Unlock(&g_prefetchLock);
+	return found;
+}
+
+void hsapi::prefetch_titles_in(const std::string& cat, const std::vector<std::string>& scats)
+{
+	LightLock_Lock(&g_prefetchLock);
+	if(!g_prefetcher)
+	{
+		LightEvent_Init(&g_prefetchWake, RESET_ONESHOT);
+		LightEvent_Init(&g_prefetchDone, RESET_ONESHOT);
+		g_prefetcher = new ctr::thread<>(prefetch_worker, 1);
+	}
+	/* whatever was wanted before isn't anymore */
+	g_prefetchWanted.clear();
+	bool keepCurrent = false;
+	for(const std::string& scat : scats)
+	{
+		std::string url = titles_in_url(cat, scat);
+		if(url == g_prefetchCurrent) keepCurrent = true;
+		else if(!is_prefetched(url))
+			g_prefetchWanted.push_back(url);
+	}
+	/* don't spend the bandwidth on something the user moved away from */
+	if(!keepCurrent && g_prefetchCurrent.size() != 0)
+		g_prefetchCancel = true;
+	LightLock_Unlock(&g_prefetchLock);
+	LightEvent_Signal(&g_prefetchWake);
+}
+
 Result hsapi::titles_in(std::vector<hsapi::Title>& ret, const std::string& cat, const std::string& scat)
 {
 	ilog("calling api");
-	json j;
+	std::string url = titles_in_url(cat, scat);
+	std::string data;
 	Result res;
-	if(R_FAILED(res = basereq<json>(HS_BASE_LOC "/title/category/" + cat + "/" + scat, j)))
+	if(!take_prefetched(url, data) && R_FAILED(res = cachedreq(url, data)))
 		return res;
-	CHECKAPI(A);
-
-	return serialize_titles(ret, j["value"]);
+	return title_sax<hsapi::Title>(&ret).parse(data);
 }
 
 Result hsapi::title_meta(hsapi::FullTitle& ret, hsapi::hid id)
@@ -450,6 +1340,79 @@ Result hsapi::title_meta(hsapi::FullTitle& ret, hsapi::hid id)
 	return serialize_full_title(ret, j["value"]);
 }
 
+/* the api has no multi-id title endpoint, so batches are fetched by a few workers at
+ * once which each keep their connection alive between requests */
+#define BATCH_WORKERS 4
+
+typedef struct meta_batch
+{
+	const std::vector<hsapi::hid> *ids;
+	std::vector<hsapi::FullTitle> metas;
+	std::vector<Result> results;
+	volatile bool *cancel; /* the one the caller passed, or cancelled */
+	volatile bool cancelled;
+	LightLock lock;
+	size_t next;
+} meta_batch;
+
+static void meta_batch_worker(meta_batch& batch)
+{
+	hsapi::background_scope scope(batch.cancel);
+	size_t i;
+	while(true)
+	{
+		LightLock_Lock(&batch.lock);
+		i = batch.next++;
+		LightLock_Unlock(&batch.lock);
+		if(i >= batch.ids->size())
+			break;
+		batch.results[i] = hsapi::title_meta(batch.metas[i], (*batch.ids)[i]);
+	}
+}
+
+Result hsapi::title_meta_batch(std::vector<hsapi::FullTitle>& ret, const std::vector<hsapi::hid>& ids, volatile bool *cancel)
+{
+	ctr::thread<meta_batch&> *workers[BATCH_WORKERS];
+	size_t nworkers = ids.size() < BATCH_WORKERS ? ids.size() : BATCH_WORKERS;
+	u64 start = osGetTime();
+	Result res = OK;
+	meta_batch batch;
+
+	if(ids.size() == 0) return OK;
+	batch.ids = &ids;
+	batch.metas.resize(ids.size());
+	batch.results.resize(ids.size(), OK);
+	LightLock_Init(&batch.lock);
+	batch.cancelled = false;
+	/* without a flag of the caller the ui thread cancels the workers itself below */
+	batch.cancel = cancel ? cancel : t_background ? t_cancelled : &batch.cancelled;
+	batch.next = 0;
+
+	for(size_t i = 0; i < nworkers; ++i)
+		workers[i] = new ctr::thread<meta_batch&>(meta_batch_worker, 1, batch);
+	if(batch.cancel == &batch.cancelled)
+		ui::loading_until([&batch, &workers, nworkers]() -> bool {
+			/* the workers don't read input, loading_until() scanned it on this thread */
+			if(hidKeysHeld() & (KEY_B | KEY_START)) batch.cancelled = true;
+			for(size_t i = 0; i < nworkers; ++i)
+				if(!workers[i]->finished()) return false;
+			return true;
+		});
+	for(size_t i = 0; i < nworkers; ++i)
+		delete workers[i];
+
+	/* failed titles are left out, the first error is returned */
+	for(size_t i = 0; i < ids.size(); ++i)
+	{
+		if(R_SUCCEEDED(batch.results[i]))
+			ret.push_back(std::move(batch.metas[i]));
+		else if(R_SUCCEEDED(res))
+			res = batch.results[i];
+	}
+	ilog("fetched %u/%u titles over %u connections in %llu ms", ret.size(), ids.size(), nworkers, osGetTime() - start);
+	return res;
+}
+
 Result hsapi::get_download_link(std::string& ret, const hsapi::Title& meta)
 {
 	ilog("calling api");
@@ -467,13 +1430,11 @@ Result hsapi::get_download_link(std::string& ret, const hsapi::Title& meta)
 Result hsapi::search(std::vector<hsapi::Title>& ret, const std::unordered_map<std::string, std::string>& params)
 {
 	ilog("calling api");
-	json j;
+	std::string data;
 	Result res;
-	if(R_FAILED(res = basereq<json>(gen_url(HS_BASE_LOC "/title/search", params), j)))
+	if(R_FAILED(res = basereq(gen_url(HS_BASE_LOC "/title/search", params), data)))
 		return res;
-	CHECKAPI(A);
-
-	return serialize_titles(ret, j["value"]);
+	return title_sax<hsapi::Title>(&ret).parse(data);
 }
 
 Result hsapi::random(hsapi::FullTitle& ret)
@@ -501,29 +1462,127 @@ Result hsapi::upload_log(const char *contents, u32 size, std::string& logid)
 	return OK;
 }
 
-Result hsapi::batch_related(hsapi::BatchRelated& ret, const std::vector<hsapi::htid>& tids)
+/* title ids per batch_related request, keeps the url well under what the server accepts */
+#define BATCH_RELATED_CHUNK 32
+
+typedef struct related_batch
 {
-	ilog("calling api");
-	if(tids.size() == 0) return OK;
+	const std::vector<hsapi::htid> *tids;
+	hsapi::BatchRelated *ret;
+	LightEvent progressed;
+	LightLock lock;
+	volatile bool *cancel; /* the one of the calling thread, or cancelled */
+	volatile bool cancelled;
+	size_t next, done;
+	u32 running;
+	Result res;
+} related_batch;
 
+static Result batch_related_chunk(hsapi::BatchRelated& ret, const hsapi::htid *tids, size_t count)
+{
 	std::string url = HS_BASE_LOC "/title/related/batch?title_ids=" + ctr::tid_to_str(tids[0]);
-	for(size_t i = 1; i < tids.size(); ++i) url += "&title_ids=" + ctr::tid_to_str(tids[i]);
+	for(size_t i = 1; i < count; ++i) url += "&title_ids=" + ctr::tid_to_str(tids[i]);
 
-	json j;
+	std::string data;
 	Result res = OK;
-	if(R_FAILED(res = basereq<json>(url, j)))
+	if(R_FAILED(res = basereq(url, data)))
 		return res;
-	CHECKAPI(OBJ);
-	j = j["value"];
+	return title_sax<hsapi::FullTitle>(&ret).parse(data);
+}
 
-	for(json::iterator it = j.begin(); it != j.end(); ++it)
+static void related_batch_worker(related_batch& batch)
+{
+	hsapi::background_scope scope(batch.cancel);
+	hsapi::BatchRelated part;
+	size_t start, count;
+	Result res;
+	while(true)
 	{
-		htid tid = ctr::str_to_tid(it.key());
-		if(serialize_full_titles(ret[tid], it.value()) != OK)
-			return APPERR_JSON_FAIL;
+		LightLock_Lock(&batch.lock);
+		start = batch.next;
+		/* stop handing out chunks after a failure */
+		if(R_FAILED(batch.res) || start >= batch.tids->size())
+		{
+			--batch.running;
+			LightLock_Unlock(&batch.lock);
+			LightEvent_Signal(&batch.progressed);
+			break;
+		}
+		count = batch.tids->size() - start < BATCH_RELATED_CHUNK ? batch.tids->size() - start : BATCH_RELATED_CHUNK;
+		batch.next += count;
+		LightLock_Unlock(&batch.lock);
+
+		part.clear();
+		res = batch_related_chunk(part, batch.tids->data() + start, count);
+
+		LightLock_Lock(&batch.lock);
+		if(R_FAILED(res))
+		{
+			if(R_SUCCEEDED(batch.res)) batch.res = res;
+		}
+		else
+		{
+			for(hsapi::BatchRelated::iterator it = part.begin(); it != part.end(); ++it)
+				(*batch.ret)[it->first].swap(it->second);
+			batch.done += count;
+		}
+		LightLock_Unlock(&batch.lock);
+		LightEvent_Signal(&batch.progressed);
 	}
+}
 
-	return OK;
+Result hsapi::batch_related(hsapi::BatchRelated& ret, const std::vector<hsapi::htid>& tids, std::function<void(size_t, size_t)> prog)
+{
+	ilog("calling api");
+	if(tids.size() == 0) return OK;
+
+	size_t nchunks = (tids.size() + BATCH_RELATED_CHUNK - 1) / BATCH_RELATED_CHUNK;
+	size_t nworkers = nchunks < BATCH_WORKERS ? nchunks : BATCH_WORKERS;
+	ctr::thread<related_batch&> *workers[BATCH_WORKERS];
+	u64 start = osGetTime();
+	related_batch batch;
+	size_t done;
+	bool running;
+
+	batch.tids = &tids;
+	batch.ret = &ret;
+	LightEvent_Init(&batch.progressed, RESET_ONESHOT);
+	LightLock_Init(&batch.lock);
+	batch.running = nworkers;
+	batch.next = batch.done = 0;
+	batch.res = OK;
+	batch.cancelled = false;
+	/* the ui thread cancels the workers itself below */
+	batch.cancel = t_background ? t_cancelled : &batch.cancelled;
+
+	for(size_t i = 0; i < nworkers; ++i)
+		workers[i] = new ctr::thread<related_batch&>(related_batch_worker, 1, batch);
+
+	/* progress is reported on this thread so the callback can draw, the ui thread
+	 * doesn't block on the workers so it keeps drawing and reading input meanwhile */
+	do {
+		if(t_background) LightEvent_Wait(&batch.progressed);
+		else LightEvent_WaitTimeout(&batch.progressed, 16666667LL); /* a frame */
+		LightLock_Lock(&batch.lock);
+		running = batch.running != 0;
+		done = batch.done;
+		LightLock_Unlock(&batch.lock);
+		if(prog) prog(done, tids.size());
+		if(!t_background && (ui::RenderQueue::get_keys().kHeld & (KEY_B | KEY_START)))
+			batch.cancelled = true;
+	} while(running);
+
+	for(size_t i = 0; i < nworkers; ++i)
+		delete workers[i];
+
+	ilog("fetched related titles of %u title(s) in %u request(s) over %u connections in %llu ms",
+		tids.size(), nchunks, nworkers, osGetTime() - start);
+	return batch.res;
+}
+
+Result hsapi::batch_related(hsapi::BatchRelated& ret, const std::vector<hsapi::htid>& tids)
+{
+	return hsapi::batch_related(ret, tids, nullptr);
 }
 
 Result hsapi::get_latest_version_string(std::string& ret)
@@ -539,13 +1598,11 @@ Result hsapi::get_latest_version_string(std::string& ret)
 Result hsapi::get_by_title_id(std::vector<Title>& ret, const std::string& title_id)
 {
 	ilog("calling api");
-	json j;
+	std::string data;
 	Result res = OK;
-	if(R_FAILED(res = basereq<json>(HS_BASE_LOC "/title/id/" + title_id, j)))
+	if(R_FAILED(res = basereq(HS_BASE_LOC "/title/id/" + title_id, data)))
 		return res;
-	CHECKAPI(A);
-
-	return serialize_titles(ret, j["value"]);
+	return title_sax<hsapi::Title>(&ret).parse(data);
 }
 
 Result hsapi::get_theme_preview_png(std::string& ret, hsapi::hid id)
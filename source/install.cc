@@ -16,15 +16,25 @@
 
 #include "settings.hh"
 #include "install.hh"
+#include "content.hh"
+#include "titledb.hh"
 #include "thread.hh"
 #include "update.hh" /* includes net constants */
 #include "error.hh"
 #include "proxy.hh"
+#include "range.hh"
+#include "ring.hh"
 #include "panic.hh"
 #include "ctr.hh"
 #include "log.hh"
 
 #include <3ds.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
 
 namespace ui
 {
@@ -33,8 +43,31 @@ namespace ui
 	u32 kHeld();
 }
 
-//#define BUFSIZE 0x80000
-#define BUFSIZE 0x10000
+/* the receive chunk size is picked at runtime between CHUNK_MIN and the
+ * buffer size, which is at most CHUNK_MAX_OLD/CHUNK_MAX_NEW */
+#define CHUNK_MIN     0x10000
+#define CHUNK_MAX_OLD 0x40000
+#define CHUNK_MAX_NEW 0x100000
+/* grow the chunk if receiving it took less than CHUNK_GROW_MS,
+ * shrink it if it took more than CHUNK_SHRINK_MS */
+#define CHUNK_GROW_MS   250
+#define CHUNK_SHRINK_MS 2000
+/* memory that has to be left over after allocating the buffers */
+#define RING_HEADROOM 0x200000
+/* amount of data of the next title in the queue fetched while the current one finishes */
+#define LOOKAHEAD_SIZE_OLD 0x100000
+#define LOOKAHEAD_SIZE_NEW 0x200000
+/* where titles are downloaded to before they're installed if spooling */
+#define SPOOL_DIR "/3ds/3hs/spool/"
+/* write the journal every time this much more is spooled */
+#define SPOOL_CHECKPOINT 0x400000
+/* amount of data read from the spool at once while installing */
+#define SPOOL_READ_SIZE 0x100000
+/* file forwarders larger than this are spooled instead of downloaded into memory */
+#define FORWARDER_MEM_MAX 0x200000
+/* amount of ranged requests running at once if downloading in parallel,
+ * has to be smaller than RING_SIZE to keep the writer thread busy */
+#define PARALLEL_CONNECTIONS 3
 
 enum class ITC // inter thread communication
 {
@@ -44,9 +77,39 @@ enum class ITC // inter thread communication
 enum class ActionType {
 	install,
 	download,
+	spool,
 };
 
-using content_type = std::basic_string<u8>;
+/* <id>.journal, tells how much of <id>.part is valid */
+typedef struct spool_journal
+{
+	char magic[4]; // "3HSJ"
+	u32 offset;
+	u32 size;
+	char etag[128];
+} spool_journal;
+
+/* the start of the next title in the queue, fetched while the previous one is finished up */
+typedef struct cia_lookahead
+{
+	// Title that is fetched
+	hsapi::FullTitle meta;
+	// Fetches the download link and the first bytes of meta
+	ctr::thread<cia_lookahead&> *th = nullptr;
+	// Location after following redirects
+	std::string url;
+	// Open response, positioned right after the spooled data
+	httpcContext ctx;
+	// First size bytes of the cia
+	u8 *spool = nullptr;
+	u32 size = 0;
+	// Total cia size
+	u32 totalSize = 0;
+	// Result of the thread, nothing is spooled on failure
+	Result res = 0;
+	// Set when the look-ahead isn't wanted anymore, cancels the api request
+	volatile bool cancel = false;
+} cia_lookahead;
 
 typedef struct cia_net_data
 {
@@ -58,14 +121,34 @@ typedef struct cia_net_data
 	};
 	// At what index are we writing __the cia__ now?
 	u32 index = 0;
+	// How much of the cia did we receive? always >= index
+	u32 received = 0;
 	// Total cia size
 	u32 totalSize = 0;
+	// Amount of data we try to receive at once
+	u32 chunk = CHUNK_MIN;
 	// Messages back and forth the UI/Install thread
 	ITC itc = ITC::normal;
-	// Buffer. allocated on heap for extra storage
-	u8 *buffer = nullptr;
-	// amount of data in the buffer
-	u32 bufferSize = 0;
+	// Buffers between the network and the writer thread
+	ring::buffer_ring ring;
+	// Connections, only the first one is used if we aren't downloading in parallel
+	httpcContext conns[PARALLEL_CONNECTIONS] = { };
+	// Which of conns hold an open request, the UI thread only cancels those
+	bool connOpen[PARALLEL_CONNECTIONS] = { };
+	// Protects connOpen, conns are only closed while holding it
+	LightLock connLock;
+	// Download using multiple ranged requests at once?
+	bool parallel = false;
+	// Start of the cia fetched ahead of time, adopted before anything is requested
+	cia_lookahead *ahead = nullptr;
+	// File we write to if spooling, or read from when installing the spooled cia
+	FILE *spool = nullptr;
+	// Path of the spool without extension
+	std::string spoolpath;
+	// Value of index the journal was last written at
+	u32 checkpoint = 0;
+	// ETag of the cia if spooling, the spool is thrown away if it changed
+	char etag[128] = "";
 	// Tells second thread to wake up
 	Handle eventHandle;
 	// Type of action
@@ -73,48 +156,377 @@ typedef struct cia_net_data
 } cia_net_data;
 
 
-static Result i_install_net_cia(std::string url, cia_net_data *data, size_t from, httpcContext *pctx)
+typedef struct cia_net_parallel
 {
-	u32 status = 0, dled = 0, remaining, dlnext, written;
+	cia_net_data *data;
+	// Location after following redirects
+	std::string url;
+	// Offset of the next block to receive
+	u32 next;
+	// First error any of the connections ran into
 	Result res = 0;
-#define CHECKRET(expr) if(R_FAILED(res = ( expr ) )) goto err
+	// Protects next, res and data->chunk
+	LightLock lock;
+} cia_net_parallel;
 
-	/* configure */
-	if(R_FAILED(res = httpcOpenContext(pctx, HTTPC_METHOD_GET, url.c_str(), 0)))
-		return res;
-	CHECKRET(httpcSetSSLOpt(pctx, SSLCOPT_DisableVerify));
-	CHECKRET(httpcSetKeepAlive(pctx, HTTPC_KEEPALIVE_ENABLED));
-	CHECKRET(httpcAddRequestHeaderField(pctx, "Connection", "Keep-Alive"));
-	CHECKRET(httpcAddRequestHeaderField(pctx, "User-Agent", USER_AGENT));
-	CHECKRET(proxy::apply(pctx));
+/* title to fetch ahead once the current title is received */
+static hsapi::FullTitle g_lookahead_next;
+static bool g_lookahead_armed = false;
+static cia_lookahead g_lookahead;
 
-	if(from != 0)
+
+static bool i_content_reserve(content_type& content, u32 size)
+{
+	if(content.reserve(size))
+		return true;
+	elog("failed to allocate 0x%lX bytes for content", size);
+	return false;
+}
+
+static void i_spool_checkpoint(cia_net_data& data)
+{
+	spool_journal journal;
+	FILE *f;
+
+	/* the journal may never claim more than what is actually on the SD */
+	if(fflush(data.spool) != 0)
+		return;
+	memcpy(journal.magic, "3HSJ", 4);
+	journal.offset = data.index;
+	journal.size = data.totalSize;
+	memcpy(journal.etag, data.etag, sizeof(journal.etag));
+	if(!(f = fopen((data.spoolpath + ".journal").c_str(), "wb")))
+		return;
+	if(fwrite(&journal, sizeof(journal), 1, f) == 1)
+		data.checkpoint = data.index;
+	fclose(f);
+	dlog("spool checkpoint at 0x%lX/0x%lX", data.index, data.totalSize);
+}
+
+static Result i_install_write(cia_net_data& data, u8 *buffer, u32 size)
+{
+	if(data.type == ActionType::install)
+	{
+		u32 written;
+		/* we don't need to add the FS_WRITE_FLUSH flag because AM just ignores write flags... */
+		return FSFILE_Write(data.cia, &written, data.index, buffer, size, 0);
+	}
+	if(data.type == ActionType::spool)
+	{
+		if(fseek(data.spool, data.index, SEEK_SET) != 0 || fwrite(buffer, size, 1, data.spool) != 1)
+			return APPERR_SPOOL_FAIL;
+		return 0;
+	}
+	if(!data.content->append(buffer, size, data.totalSize))
 	{
-		CHECKRET(httpcAddRequestHeaderField(pctx, "Range", ("bytes=" + std::to_string(from) + "-").c_str()));
+		elog("failed to grow content to 0x%lX bytes", data.content->size + size);
+		return APPERR_OUT_OF_MEM;
 	}
+	return 0;
+}
+
+static void i_install_write_slot(cia_net_data& data, u32 slot)
+{
+	ring::buffer_ring& buffers = data.ring;
+	/* ITC::exit is only set while we still have buffers if the install was aborted */
+	if(data.itc == ITC::exit)
+	{
+		dlog("discarding buffers due to ITC::exit");
+		buffers.res = APPERR_CANCELLED;
+		return;
+	}
+	dlog("Writing, size=%lu,index=%lu,totalSize=%lu", buffers.sizes[slot], data.index, data.totalSize);
+	if(R_FAILED(buffers.res = i_install_write(data, buffers.buffers[slot], buffers.sizes[slot])))
+	{
+		elog("failed to write buffer: %08lX", buffers.res);
+		return;
+	}
+	data.index += buffers.sizes[slot];
+	if(data.type == ActionType::spool && data.index - data.checkpoint >= SPOOL_CHECKPOINT)
+		i_spool_checkpoint(data);
+}
+
+static void i_install_writer_thread_cb(cia_net_data& data)
+{
+	ring::writer(data, [&data](u32 slot) -> void { i_install_write_slot(data, slot); });
+}
+
+static Result i_ring_alloc(ring::buffer_ring& buffers)
+{
+	bool isNew = false;
+	APT_CheckNew3DS(&isNew);
+
+	for(buffers.bufsize = isNew ? CHUNK_MAX_NEW : CHUNK_MAX_OLD; buffers.bufsize >= CHUNK_MIN; buffers.bufsize /= 2)
+	{
+		/* we don't want to take the last bit of memory the rest of 3hs needs */
+		void *headroom = malloc(RING_HEADROOM);
+		size_t i = 0;
+		if(headroom)
+		{
+			for(; i < RING_SIZE; ++i)
+				if(!(buffers.buffers[i] = (u8 *) malloc(buffers.bufsize)))
+					break;
+			free(headroom);
+		}
+		if(i == RING_SIZE)
+		{
+			ilog("allocated %u buffers of 0x%lX bytes", RING_SIZE, buffers.bufsize);
+			ring::init(buffers);
+			return 0;
+		}
+		while(i != 0)
+			free(buffers.buffers[--i]);
+	}
+
+	elog("failed to allocate buffers");
+	return APPERR_OUT_OF_MEM;
+}
+
+static void i_ring_free(ring::buffer_ring& buffers)
+{
+	for(size_t i = 0; i < RING_SIZE; ++i)
+		free(buffers.buffers[i]);
+}
 
-	CHECKRET(httpcBeginRequest(pctx));
+/* larger chunks mean less IPC calls, but we can't go so high the receive call times out */
+static void i_adapt_chunk(cia_net_data *data, u32 size, u64 ms)
+{
+	u32 nchunk = data->chunk;
+	/* the last (smaller) chunk doesn't say anything about the throughput */
+	if(size != data->chunk) return;
 
-	CHECKRET(httpcGetResponseStatusCode(pctx, &status));
-	vlog("Download status code: %lu", status);
+	if(ms < CHUNK_GROW_MS && nchunk < data->ring.bufsize) nchunk *= 2;
+	else if(ms > CHUNK_SHRINK_MS && nchunk > CHUNK_MIN)  nchunk /= 2;
+	if(nchunk == data->chunk) return;
 
-	// Do we want to redirect?
-	if(status / 100 == 3)
+	ilog("chunk size is now 0x%lX, received 0x%lX bytes in %llums", nchunk, size, ms);
+	data->chunk = nchunk;
+}
+
+/* opens a GET request to url and follows redirects, url is set to the final location.
+ * the context is closed on failure. the range is only honoured if the content still has
+ * the ETag ifrange if it isn't empty */
+static Result i_open_request(std::string& url, httpcContext *pctx, const std::string& range, u32 *status, const char *ifrange = "")
+{
+	Result res;
+#define CHECKRET(expr) if(R_FAILED(res = ( expr ) )) goto err
+
+	for(;;)
 	{
+		/* configure */
+		if(R_FAILED(res = httpcOpenContext(pctx, HTTPC_METHOD_GET, url.c_str(), 0)))
+			return res;
+		CHECKRET(httpcSetSSLOpt(pctx, SSLCOPT_DisableVerify));
+		CHECKRET(httpcSetKeepAlive(pctx, HTTPC_KEEPALIVE_ENABLED));
+		CHECKRET(httpcAddRequestHeaderField(pctx, "Connection", "Keep-Alive"));
+		CHECKRET(httpcAddRequestHeaderField(pctx, "User-Agent", USER_AGENT));
+		CHECKRET(proxy::apply(pctx));
+
+		if(range.size() != 0)
+		{
+			CHECKRET(httpcAddRequestHeaderField(pctx, "Range", range.c_str()));
+			if(*ifrange != '\0')
+				CHECKRET(httpcAddRequestHeaderField(pctx, "If-Range", ifrange));
+		}
+
+		CHECKRET(httpcBeginRequest(pctx));
+
+		CHECKRET(httpcGetResponseStatusCode(pctx, status));
+		vlog("Download status code: %lu", *status);
+
+		// Do we want to redirect?
+		if(*status / 100 != 3)
+			return 0;
+
 		char newurl[2048];
 		CHECKRET(httpcGetResponseHeader(pctx, "location", newurl, sizeof(newurl)));
 		newurl[sizeof(newurl) - 1] = '\0';
-		std::string redir(newurl);
+		url = newurl;
 
-		vlog("Redirected to %s", redir.c_str());
+		vlog("Redirected to %s", url.c_str());
 		httpcCancelConnection(pctx);
 		httpcCloseContext(pctx);
-		return i_install_net_cia(redir, data, from, pctx);
 	}
 
+err:
+	httpcCancelConnection(pctx);
+	httpcCloseContext(pctx);
+	return res;
+#undef CHECKRET
+}
+
+/* remembers the ETag of the response so the spool can be validated when resuming */
+static void i_spool_read_etag(cia_net_data *data, httpcContext *pctx)
+{
+	if(data->type != ActionType::spool)
+		return;
+	if(R_FAILED(httpcGetResponseHeader(pctx, "ETag", data->etag, sizeof(data->etag))))
+		data->etag[0] = '\0';
+	data->etag[sizeof(data->etag) - 1] = '\0';
+}
+
+/* marks pctx, one of data->conns, as holding a request i_open_request() opened */
+static void i_conn_opened(cia_net_data *data, httpcContext *pctx)
+{
+	size_t i = pctx - data->conns;
+	panic_assert(i < PARALLEL_CONNECTIONS, "context is not one of data->conns");
+	LightLock_Lock(&data->connLock);
+	data->connOpen[i] = true;
+	LightLock_Unlock(&data->connLock);
+}
+
+/* closes pctx, one of data->conns, so the UI thread can't cancel it while or after it's closed */
+static void i_conn_close(cia_net_data *data, httpcContext *pctx)
+{
+	size_t i = pctx - data->conns;
+	panic_assert(i < PARALLEL_CONNECTIONS, "context is not one of data->conns");
+	LightLock_Lock(&data->connLock);
+	data->connOpen[i] = false;
+	httpcCloseContext(pctx);
+	LightLock_Unlock(&data->connLock);
+}
+
+/* cancels the requests that are open right now, called from the UI thread */
+static void i_conns_cancel(cia_net_data *data)
+{
+	LightLock_Lock(&data->connLock);
+	for(size_t i = 0; i < PARALLEL_CONNECTIONS; ++i)
+		if(data->connOpen[i])
+			httpcCancelConnection(&data->conns[i]);
+	LightLock_Unlock(&data->connLock);
+}
+
+/* throws away everything that was spooled */
+static void i_spool_reset(cia_net_data *data)
+{
+	data->index = data->received = data->checkpoint = 0;
+	data->etag[0] = '\0';
+	/* the journal mustn't vouch for the old data if we're interrupted before the next checkpoint */
+	if(data->spool != nullptr && (fflush(data->spool) != 0 || ftruncate(fileno(data->spool), 0) != 0))
+		wlog("failed to truncate the spool: %s", strerror(errno));
+	i_spool_checkpoint(*data);
+}
+
+/* the content changed since it was spooled, so we have to start over */
+static void i_spool_restart(cia_net_data *data, httpcContext *pctx)
+{
+	ilog("spooled data is outdated, starting over");
+	httpcCancelConnection(pctx);
+	i_conn_close(data, pctx);
+	ring::flush(*data);
+	i_spool_reset(data);
+}
+
+static std::string i_range_header(u32 from, u32 size)
+{
+	return range::header(from, size);
+}
+
+/* receives the response to a request for i_range_header(from, size) on the opened context pctx */
+static Result i_receive_range(httpcContext *pctx, u8 *buffer, u32 size)
+{
+	u32 dled = 0;
+	/* 8 seconds timeout */
+	Result res = httpcReceiveDataTimeout(pctx, buffer, size, 8000000000L);
+	vlog("httpcReceiveDataTimeout(): 0x%08lX", res);
+	if(R_FAILED(res) || R_FAILED(res = httpcGetDownloadSizeState(pctx, &dled, nullptr)))
+		return res;
+	if(dled != size)
+	{
+		elog("expected a range of %lu bytes but got %lu", size, dled);
+		return APPERR_NORANGE;
+	}
+	return 0;
+}
+
+/* receives the response on the opened context pctx, which starts at from.
+ * data->received - from bytes of the response may already be received */
+static Result i_receive_stream(cia_net_data *data, size_t from, httpcContext *pctx)
+{
+	u32 dled = 0, dlnext, slot;
+	Result res = 0;
+	u64 start;
+
+	svcSignalEvent(data->eventHandle);
+
+	// Install.
+	panic_assert(data->totalSize > from, "invalid download start position");
+	panic_assert(data->received >= from, "resuming at a different position than we received");
+	dlnext = range::block(data->totalSize, data->received, data->chunk);
+
+	while(data->received != data->totalSize)
+	{
+		/* blocks if the writer thread has not caught up yet */
+		slot = ring::acquire(data->ring);
+		dlog("receiving data, dlnext=%lu, progress is (session:%lu)%lu/%lu", dlnext, dled, data->received, data->totalSize);
+		panic_if(dlnext > data->ring.bufsize, "dlnext is invalid");
+		start = osGetTime();
+		/* 8 seconds timeout */
+		res = httpcReceiveDataTimeout(pctx, data->ring.buffers[slot], dlnext, 8000000000L);
+		vlog("httpcReceiveDataTimeout(): 0x%08lX", res);
+		if((R_FAILED(res) && res != (Result) HTTPC_RESULTCODE_DOWNLOADPENDING) || R_FAILED(res = httpcGetDownloadSizeState(pctx, &dled, nullptr)))
+		{
+			elog("aborted http connection due to error: %08lX.", res);
+			ring::release(data->ring, slot);
+			goto err;
+		}
+		panic_assert(dled + from == data->received + dlnext, "only a chunk was downloaded");
+		i_adapt_chunk(data, dlnext, osGetTime() - start);
+
+#define CHK_EXIT(...) \
+		if(data->itc == ITC::exit) \
+		{ \
+			__VA_ARGS__; \
+			dlog("aborted http connection due to ITC::exit"); \
+			res = APPERR_CANCELLED; \
+			goto cancelled; \
+		}
+		CHK_EXIT(ring::release(data->ring, slot))
+		ring::submit(*data, slot, data->received, dlnext);
+		/* the writer thread failed; there is no point in receiving more data */
+		if(R_FAILED(res = data->ring.res))
+			goto err;
+		CHK_EXIT()
+#undef CHK_EXIT
+
+		dlnext = range::block(data->totalSize, data->received, data->chunk);
+		svcSignalEvent(data->eventHandle);
+	}
+
+	/* everything is received, but we're only done once everything is written */
+	res = ring::drain(*data);
+
+err:
+	httpcCancelConnection(pctx);
+cancelled:
+	i_conn_close(data, pctx);
+	if(data->index == data->totalSize)
+		data->itc = ITC::exit;
+	svcSignalEvent(data->eventHandle);
+	return res;
+}
+
+static Result i_install_net_cia(std::string url, cia_net_data *data, size_t from, httpcContext *pctx)
+{
+	u32 status = 0;
+	Result res;
+
+	panic_assert(data->received == from, "resuming at a different position than we received");
+	if(R_FAILED(res = i_open_request(url, pctx, from != 0 ? i_range_header(from, 0) : "", &status, data->etag)))
+		return res;
+	i_conn_opened(data, pctx);
+
 	// Are we resuming and does the server support range?
 	if(from != 0)
 	{
+		u32 length = 0;
+		/* If-Range didn't match or the size changed, the spool is useless */
+		if(data->type == ActionType::spool && (status == 200 || (status == 206
+			&& R_SUCCEEDED(httpcGetDownloadSizeState(pctx, nullptr, &length)) && length != data->totalSize - from)))
+		{
+			i_spool_restart(data, pctx);
+			return i_install_net_cia(url, data, 0, pctx);
+		}
 		/* fuck me
 		 * before this if used to be && meaning if from != 0 it would always fail
 		 * reason: status != 200 check was added later than range support */
@@ -134,8 +546,8 @@ static Result i_install_net_cia(std::string url, cia_net_data *data, size_t from
 	}
 
   /* Only if from is 0 do we get the full size, else this would return fullSize - from */
-	if(from == 0)
-		CHECKRET(httpcGetDownloadSizeState(pctx, nullptr, &data->totalSize));
+	if(from == 0 && R_FAILED(res = httpcGetDownloadSizeState(pctx, nullptr, &data->totalSize)))
+		goto err;
 	/* else data->totalSize is already known */
 	if(data->totalSize == 0)
 	{
@@ -149,86 +561,393 @@ static Result i_install_net_cia(std::string url, cia_net_data *data, size_t from
 		res = APPERR_NOSIZE;
 		goto err;
 	}
+	if(from == 0)
+		i_spool_read_etag(data, pctx);
+
+	return i_receive_stream(data, from, pctx);
+
+err:
+	httpcCancelConnection(pctx);
+	i_conn_close(data, pctx);
 	svcSignalEvent(data->eventHandle);
+	return res;
+}
 
-	// Install.
-	panic_assert(data->totalSize > from, "invalid download start position");
-	remaining = data->totalSize - from;
-	dlnext = remaining < BUFSIZE ? remaining : BUFSIZE;
-	written = 0;
+/* receives blocks of data->chunk bytes with their own ranged request until
+ * everything is handed out or any of the connections failed */
+static void i_range_worker_cb(cia_net_parallel& par, httpcContext& ctx)
+{
+	cia_net_data *data = par.data;
+	u32 slot, offset, size, status;
+	std::string url;
+	Result res;
+	u64 start;
 
-	while(data->index != data->totalSize)
+	LightLock_Lock(&par.lock);
+	url = par.url;
+	LightLock_Unlock(&par.lock);
+
+	for(;;)
 	{
-		dlog("receiving data, dlnext=%lu, progress is (session:%lu)%lu/%lu", dlnext, dled, data->index, data->totalSize);
-		panic_if(dlnext > BUFSIZE, "dlnext is invalid");
-		/* 8 seconds timeout */
-		res = httpcReceiveDataTimeout(pctx, data->buffer, dlnext, 8000000000L);
-		vlog("httpcReceiveDataTimeout(): 0x%08lX", res);
-		if((R_FAILED(res) && res != (Result) HTTPC_RESULTCODE_DOWNLOADPENDING) || R_FAILED(res = httpcGetDownloadSizeState(pctx, &dled, nullptr)))
+		/* only claim a block once we have somewhere to put it, else
+		 * the block the writer thread waits for may never be received */
+		slot = ring::acquire(data->ring);
+		LightLock_Lock(&par.lock);
+		size = range::block(data->totalSize, par.next, data->chunk);
+		if(R_FAILED(par.res) || R_FAILED(data->ring.res) || data->itc == ITC::exit)
+			size = 0;
+		offset = par.next;
+		par.next += size;
+		LightLock_Unlock(&par.lock);
+		if(size == 0)
 		{
-			elog("aborted http connection due to error: %08lX.", res);
-			goto err;
+			ring::release(data->ring, slot);
+			break;
 		}
-		panic_assert(dled + from == data->index + dlnext, "only a chunk was downloaded");
 
-#define CHK_EXIT \
-		if(data->itc == ITC::exit) \
-		{ \
-			dlog("aborted http connection due to ITC::exit"); \
-			res = APPERR_CANCELLED; \
-			goto cancelled; \
+		dlog("receiving block, offset=%lu, size=%lu", offset, size);
+		start = osGetTime();
+		if(R_SUCCEEDED(res = i_open_request(url, &ctx, i_range_header(offset, size), &status)))
+		{
+			i_conn_opened(data, &ctx);
+			if(status != 206)
+			{
+				elog("expected 206 but got %lu", status);
+				res = APPERR_NORANGE;
+			}
+			else res = i_receive_range(&ctx, data->ring.buffers[slot], size);
+			if(R_FAILED(res)) httpcCancelConnection(&ctx);
+			i_conn_close(data, &ctx);
 		}
-		CHK_EXIT
-		dlog("Writing, size=%lu,index=%lu,totalSize=%lu,remaining=%lu", dlnext, data->index, data->totalSize, remaining);
-		if(data->type == ActionType::install)
+
+		if(R_FAILED(res))
 		{
-			/* we don't need to add the FS_WRITE_FLUSH flag because AM just ignores write flags... */
-			if(R_FAILED(res = FSFILE_Write(data->cia, &written, data->index, data->buffer, dlnext, 0)))
-				goto err;
+			elog("block at %lu failed: %08lX", offset, res);
+			ring::release(data->ring, slot);
+			LightLock_Lock(&par.lock);
+			if(R_SUCCEEDED(par.res)) par.res = res;
+			LightLock_Unlock(&par.lock);
+			break;
 		}
-		else
-			data->content->append(data->buffer, dlnext);
-		remaining -= dlnext;
-		data->index += dlnext;
-		CHK_EXIT
-#undef CHK_EXIT
 
-		dlnext = remaining < BUFSIZE ? remaining : BUFSIZE;
+		LightLock_Lock(&par.lock);
+		i_adapt_chunk(data, size, osGetTime() - start);
+		LightLock_Unlock(&par.lock);
+		ring::submit(*data, slot, offset, size);
 		svcSignalEvent(data->eventHandle);
 	}
+}
+
+/* like i_install_net_cia(), but splits the download over PARALLEL_CONNECTIONS connections
+ * and falls back to a single connection if the server doesn't do ranges. *adopted is a response
+ * that already continues at from, it's closed and set to null once the ranges work. if they don't
+ * APPERR_NORANGE is returned and it's left to the caller */
+static Result i_install_net_cia_parallel(std::string url, cia_net_data *data, size_t from, httpcContext **adopted = nullptr)
+{
+	ctr::thread<cia_net_parallel&, httpcContext&> *workers[PARALLEL_CONNECTIONS];
+	httpcContext *pctx = &data->conns[0];
+	u32 status = 0, size, slot, fullSize;
+	cia_net_parallel par;
+	char crange[64];
+	char *total;
+	Result res;
+
+	/* the first block tells us if the server supports ranges at all */
+	slot = ring::acquire(data->ring);
+	size = data->chunk;
+	if(from != 0 && data->totalSize - from < size)
+		size = data->totalSize - from;
+	if(R_FAILED(res = i_open_request(url, pctx, i_range_header(from, size), &status, data->etag)))
+	{
+		ring::release(data->ring, slot);
+		return res;
+	}
+	i_conn_opened(data, pctx);
+
+	switch(range::classify(status, from, data->type == ActionType::spool && (adopted == nullptr || *adopted == nullptr)))
+	{
+	case range::reply::ranged:
+		break;
+	case range::reply::restart:
+		ring::release(data->ring, slot);
+		i_spool_restart(data, pctx);
+		return i_install_net_cia_parallel(url, data, 0);
+	case range::reply::whole:
+		ilog("server ignored the range request, falling back to a single connection");
+		ring::release(data->ring, slot);
+		data->parallel = false;
+		if(R_FAILED(res = httpcGetDownloadSizeState(pctx, nullptr, &data->totalSize)) || data->totalSize == 0)
+		{
+			httpcCancelConnection(pctx);
+			i_conn_close(data, pctx);
+			return R_FAILED(res) ? res : APPERR_NOSIZE;
+		}
+		return i_receive_stream(data, from, pctx);
+	case range::reply::norange:
+		elog("expected 206 but got %lu", status);
+		res = APPERR_NORANGE;
+		goto err;
+	}
+
+	/* the other connections take over from here */
+	if(adopted != nullptr && *adopted != nullptr)
+	{
+		httpcCancelConnection(*adopted);
+		httpcCloseContext(*adopted);
+		*adopted = nullptr;
+	}
+
+	/* Content-Range: bytes <start>-<end>/<total> */
+	if(R_FAILED(res = httpcGetResponseHeader(pctx, "Content-Range", crange, sizeof(crange))))
+		goto err;
+	crange[sizeof(crange) - 1] = '\0';
+	if((total = strrchr(crange, '/')) == nullptr || (fullSize = strtoul(total + 1, nullptr, 10)) == 0)
+	{
+		elog("invalid Content-Range: %s", crange);
+		res = APPERR_NOSIZE;
+		goto err;
+	}
+	if(from != 0 && data->type == ActionType::spool && fullSize != data->totalSize)
+	{
+		ring::release(data->ring, slot);
+		i_spool_restart(data, pctx);
+		return i_install_net_cia_parallel(url, data, 0);
+	}
+	if((data->totalSize = fullSize) <= from)
+	{
+		elog("invalid Content-Range: %s", crange);
+		res = APPERR_NOSIZE;
+		goto err;
+	}
+	if(size > data->totalSize - from)
+		size = data->totalSize - from;
+	if(from == 0)
+		i_spool_read_etag(data, pctx);
+
+	if(R_FAILED(res = i_receive_range(pctx, data->ring.buffers[slot], size)))
+		goto err;
+	i_conn_close(data, pctx);
+
+	ilog("downloading 0x%lX bytes over %u connections", data->totalSize - from, PARALLEL_CONNECTIONS);
+	ring::submit(*data, slot, from, size);
+	svcSignalEvent(data->eventHandle);
+
+	par.data = data;
+	par.url = url;
+	par.next = from + size;
+	LightLock_Init(&par.lock);
+
+	for(size_t i = 0; i < PARALLEL_CONNECTIONS; ++i)
+		workers[i] = new ctr::thread<cia_net_parallel&, httpcContext&>(i_range_worker_cb, 1, par, data->conns[i]);
+	for(size_t i = 0; i < PARALLEL_CONNECTIONS; ++i)
+		delete workers[i];
+
+	if(R_SUCCEEDED(res = par.res) && data->itc == ITC::exit)
+		res = APPERR_CANCELLED;
+	if(R_SUCCEEDED(res))
+		res = ring::drain(*data);
+	else
+		/* whatever got received after the failed block has to be received again */
+		ring::flush(*data);
 
-err:
-	httpcCancelConnection(pctx);
-cancelled:
-	httpcCloseContext(pctx);
 	if(data->index == data->totalSize)
 		data->itc = ITC::exit;
 	svcSignalEvent(data->eventHandle);
 	return res;
-#undef CHECKRET
+
+err:
+	ring::release(data->ring, slot);
+	httpcCancelConnection(pctx);
+	i_conn_close(data, pctx);
+	return res;
+}
+
+static Result i_install_net_cia_any(std::string url, cia_net_data *data, size_t from)
+{
+	return data->parallel
+		? i_install_net_cia_parallel(url, data, from)
+		: i_install_net_cia(url, data, from, &data->conns[0]);
+}
+
+static void i_lookahead_thread_cb(cia_lookahead& ahead)
+{
+	u32 status = 0, dled = 0;
+	bool isNew = false;
+	u64 start = osGetTime();
+	APT_CheckNew3DS(&isNew);
+
+	/* the ui thread may be showing a prompt, so this must not read input */
+	{
+		hsapi::background_scope scope(&ahead.cancel);
+		ahead.res = hsapi::get_download_link(ahead.url, ahead.meta);
+	}
+	if(R_FAILED(ahead.res))
+		goto fail;
+	if(R_FAILED(ahead.res = i_open_request(ahead.url, &ahead.ctx, "", &status)))
+		goto fail;
+	if(status != 200)
+	{
+		elog("HTTP status was NOT 200 but instead %lu", status);
+		ahead.res = APPERR_NON200;
+		goto close;
+	}
+	if(R_FAILED(ahead.res = httpcGetDownloadSizeState(&ahead.ctx, nullptr, &ahead.totalSize)))
+		goto close;
+	if(ahead.totalSize == 0)
+	{
+		ahead.res = APPERR_NOSIZE;
+		goto close;
+	}
+
+	ahead.size = isNew ? LOOKAHEAD_SIZE_NEW : LOOKAHEAD_SIZE_OLD;
+	if(ahead.size > ahead.totalSize)
+		ahead.size = ahead.totalSize;
+	if(!(ahead.spool = (u8 *) malloc(ahead.size)))
+	{
+		ahead.res = APPERR_OUT_OF_MEM;
+		goto close;
+	}
+
+	/* 8 seconds timeout */
+	ahead.res = httpcReceiveDataTimeout(&ahead.ctx, ahead.spool, ahead.size, 8000000000L);
+	if(ahead.res == (Result) HTTPC_RESULTCODE_DOWNLOADPENDING)
+		ahead.res = 0;
+	if(R_FAILED(ahead.res) || R_FAILED(ahead.res = httpcGetDownloadSizeState(&ahead.ctx, &dled, nullptr)))
+		goto close;
+	if(dled != ahead.size)
+	{
+		ahead.res = APPERR_NOSIZE;
+		goto close;
+	}
+
+	ilog("fetched 0x%lX/0x%lX bytes of %llu ahead in %llums", ahead.size, ahead.totalSize, ahead.meta.id, osGetTime() - start);
+	return;
+
+close:
+	httpcCancelConnection(&ahead.ctx);
+	httpcCloseContext(&ahead.ctx);
+fail:
+	elog("failed to fetch %llu ahead: %08lX", ahead.meta.id, ahead.res);
+	free(ahead.spool);
+	ahead.spool = nullptr;
+}
+
+/* waits for the look-ahead thread, if there is any */
+static void i_lookahead_join(cia_lookahead& ahead)
+{
+	if(ahead.th == nullptr)
+		return;
+	delete ahead.th;
+	ahead.th = nullptr;
+}
+
+/* drops whatever was fetched ahead */
+static void i_lookahead_discard(cia_lookahead& ahead)
+{
+	ahead.cancel = true;
+	i_lookahead_join(ahead);
+	if(ahead.spool == nullptr)
+		return;
+	dlog("discarding look-ahead of %llu", ahead.meta.id);
+	httpcCancelConnection(&ahead.ctx);
+	httpcCloseContext(&ahead.ctx);
+	free(ahead.spool);
+	ahead.spool = nullptr;
 }
 
-static void i_install_loop_thread_cb(Result& res, get_url_func get_url, cia_net_data& data, httpcContext& hctx)
+/* starts fetching the next title in the queue if there is one */
+static void i_lookahead_start()
+{
+	if(!g_lookahead_armed)
+		return;
+	g_lookahead_armed = false;
+	i_lookahead_discard(g_lookahead);
+	g_lookahead.meta = g_lookahead_next;
+	g_lookahead.cancel = false;
+	g_lookahead.th = new ctr::thread<cia_lookahead&>(i_lookahead_thread_cb, 1, g_lookahead);
+}
+
+/* returns the look-ahead if it holds the start of id, anything else is discarded */
+static cia_lookahead *i_lookahead_take(hsapi::hid id)
+{
+	i_lookahead_join(g_lookahead);
+	if(g_lookahead.spool != nullptr && g_lookahead.meta.id == id)
+		return &g_lookahead;
+	i_lookahead_discard(g_lookahead);
+	return nullptr;
+}
+
+/* continues the download data->ahead started */
+static Result i_install_adopt(cia_net_data *data)
+{
+	cia_lookahead& ahead = *data->ahead;
+	u32 offset, size, slot;
+	data->ahead = nullptr;
+
+	ilog("continuing 0x%lX bytes fetched ahead", ahead.size);
+	data->totalSize = ahead.totalSize;
+	/* the look-ahead request is the one the spool gets validated against if we resume */
+	i_spool_read_etag(data, &ahead.ctx);
+	for(offset = 0; offset != ahead.size; offset += size)
+	{
+		slot = ring::acquire(data->ring);
+		size = ahead.size - offset < data->ring.bufsize ? ahead.size - offset : data->ring.bufsize;
+		memcpy(data->ring.buffers[slot], ahead.spool + offset, size);
+		ring::submit(*data, slot, offset, size);
+	}
+	free(ahead.spool);
+	ahead.spool = nullptr;
+
+	if(data->parallel && ahead.size != ahead.totalSize)
+	{
+		httpcContext *stream = &ahead.ctx;
+		Result res = i_install_net_cia_parallel(ahead.url, data, ahead.size, &stream);
+		if(stream == nullptr || res != APPERR_NORANGE)
+		{
+			if(stream != nullptr)
+			{
+				httpcCancelConnection(stream);
+				httpcCloseContext(stream);
+			}
+			return res;
+		}
+		/* the server doesn't do ranges, but the look-ahead response has everything that's left */
+		ilog("server ignored the range request, continuing the look-ahead response");
+		data->parallel = false;
+	}
+
+	data->conns[0] = ahead.ctx;
+	i_conn_opened(data, &data->conns[0]);
+	return i_receive_stream(data, 0, &data->conns[0]);
+}
+
+static void i_install_loop_thread_cb(Result& res, get_url_func get_url, cia_net_data& data)
 {
 	std::string url;
 
 	if(!ISET_RESUME_DOWNLOADS)
 	{
+		if(data.ahead != nullptr)
+		{
+			res = i_install_adopt(&data);
+			goto out;
+		}
 		if((url = get_url(res)) == "")
 		{
 			elog("failed to fetch url: %08lX", res);
 			goto out;
 		}
-		res = i_install_net_cia(url, &data, 0, &hctx);
+		res = i_install_net_cia_any(url, &data, data.received);
 		goto out;
 	}
 
 	// install loop
 	while(data.itc != ITC::exit)
 	{
-		url = get_url(res);
-		if(R_SUCCEEDED(res))
-			res = i_install_net_cia(url, &data, data.index + data.bufferSize, &hctx);
+		if(data.ahead != nullptr)
+			res = i_install_adopt(&data);
+		else if(url = get_url(res), R_SUCCEEDED(res))
+			res = i_install_net_cia_any(url, &data, data.received);
 
 		if(R_FAILED(res)) { elog("Failed in install loop. ErrCode=0x%08lX", res); }
 		if(R_MODULE(res) == RM_HTTP)
@@ -257,16 +976,24 @@ out:
 static Result i_install_resume_loop(get_url_func get_url, prog_func prog, cia_net_data *data)
 {
 	Result res;
-	data->buffer = new u8[BUFSIZE];
 
 	if(R_FAILED(res = svcCreateEvent(&data->eventHandle, RESET_ONESHOT)))
 		return res;
 
-	httpcContext hctx;
+	if(R_FAILED(res = i_ring_alloc(data->ring)))
+	{
+		svcCloseHandle(data->eventHandle);
+		return res;
+	}
+	LightLock_Init(&data->connLock);
+	data->parallel = ISET_PARALLEL_DOWNLOADS;
+
+	// Writer thread, drains the buffers the install thread receives. it mostly waits on the SD
+	ctr::task writer = ctr::pool::background().run([data]() -> void { i_install_writer_thread_cb(*data); }, 1, true);
 
 	// Install thread
-	ctr::thread<Result&, get_url_func, cia_net_data&, httpcContext&> th
-		(i_install_loop_thread_cb, 1, res, get_url, *data, hctx);
+	ctr::thread<Result&, get_url_func, cia_net_data&> th
+		(i_install_loop_thread_cb, 1, res, get_url, *data);
 
 	Handle timer;
 	svcCreateTimer(&timer, RESET_ONESHOT);
@@ -304,7 +1031,7 @@ static Result i_install_resume_loop(get_url_func get_url, prog_func prog, cia_ne
 		if(!aptMainLoop() || ((ui::kDown() | ui::kHeld()) & (KEY_B | KEY_START)))
 		{
 			res = APPERR_CANCELLED;
-			httpcCancelConnection(&hctx);
+			i_conns_cancel(data);
 			break;
 		}
 	}
@@ -312,10 +1039,53 @@ static Result i_install_resume_loop(get_url_func get_url, prog_func prog, cia_ne
 	data->itc = ITC::exit;
 	th.join();
 
+	/* tell the writer thread to stop after it drained everything */
+	data->ring.stop = true;
+	ring::flush(*data);
+	writer.join();
+
+	if(R_SUCCEEDED(res) && R_FAILED(data->ring.res))
+		res = data->ring.res;
+
 	svcCloseHandle(data->eventHandle);
 	svcCloseHandle(timer);
 
-	delete [] data->buffer;
+	i_ring_free(data->ring);
+	return res;
+}
+
+/* installs the cia spooled to data->spool */
+static Result i_install_from_spool(prog_func prog, cia_net_data *data)
+{
+	u32 size, written;
+	Result res = 0;
+	u8 *buffer;
+
+	if(!(buffer = (u8 *) malloc(SPOOL_READ_SIZE)))
+		return APPERR_OUT_OF_MEM;
+
+	rewind(data->spool);
+	for(data->index = 0; data->index != data->totalSize; data->index += size)
+	{
+		size = data->totalSize - data->index < SPOOL_READ_SIZE ? data->totalSize - data->index : SPOOL_READ_SIZE;
+		if(fread(buffer, size, 1, data->spool) != 1)
+		{
+			res = APPERR_SPOOL_FAIL;
+			break;
+		}
+		if(R_FAILED(res = FSFILE_Write(data->cia, &written, data->index, buffer, size, 0)))
+			break;
+		prog(data->index + size, data->totalSize);
+
+		ui::scan_keys();
+		if(!aptMainLoop() || ((ui::kDown() | ui::kHeld()) & (KEY_B | KEY_START)))
+		{
+			res = APPERR_CANCELLED;
+			break;
+		}
+	}
+
+	free(buffer);
 	return res;
 }
 
@@ -375,9 +1145,15 @@ static Result net_cia_impl(get_url_func get_url, hsapi::htid tid, bool reinstall
 	}
 
 	aptSetHomeAllowed(false);
-	ret = i_install_resume_loop(get_url, prog, data);
+	ret = data->spool != nullptr
+		? i_install_from_spool(prog, data)
+		: i_install_resume_loop(get_url, prog, data);
 	aptSetHomeAllowed(true);
 
+	/* the network is idle while the title is finished up */
+	if(R_SUCCEEDED(ret))
+		i_lookahead_start();
+
 	if(data->type == ActionType::install)
 	{
 		if(R_FAILED(ret))
@@ -391,11 +1167,182 @@ static Result net_cia_impl(get_url_func get_url, hsapi::htid tid, bool reinstall
 		ret = AM_FinishCiaInstall(data->cia);
 		ilog("AM_FinishCiaInstall(...): 0x%08lX", ret);
 		svcCloseHandle(data->cia);
+		if(R_SUCCEEDED(ret))
+			titledb::installed(tid, dest);
 	}
 
 	return ret;
 }
 
+/* opens the spool of id and picks up where the journal left off */
+static bool i_spool_open(hsapi::hid id, cia_net_data *data)
+{
+	spool_journal journal;
+	bool valid = false;
+	FILE *f;
+
+	mkdir("/3ds", 0777);
+	mkdir("/3ds/3hs", 0777);
+	mkdir(SPOOL_DIR, 0777);
+	data->spoolpath = SPOOL_DIR + std::to_string(id);
+
+	if((f = fopen((data->spoolpath + ".journal").c_str(), "rb")))
+	{
+		valid = fread(&journal, sizeof(journal), 1, f) == 1 && memcmp(journal.magic, "3HSJ", 4) == 0
+			&& journal.offset <= journal.size;
+		fclose(f);
+	}
+	if(valid && (data->spool = fopen((data->spoolpath + ".part").c_str(), "r+b")))
+	{
+		/* the journal is only written after the part is flushed, but the SD may disagree */
+		if(fseek(data->spool, 0, SEEK_END) == 0 && (u32) ftell(data->spool) >= journal.offset)
+		{
+			data->index = data->received = data->checkpoint = journal.offset;
+			data->totalSize = journal.size;
+			memcpy(data->etag, journal.etag, sizeof(data->etag));
+			data->etag[sizeof(data->etag) - 1] = '\0';
+			ilog("resuming spool of %llu at 0x%lX/0x%lX", id, journal.offset, journal.size);
+			return true;
+		}
+		fclose(data->spool);
+	}
+
+	return (data->spool = fopen((data->spoolpath + ".part").c_str(), "w+b")) != nullptr;
+}
+
+static void i_spool_close(cia_net_data *data, bool remove_files)
+{
+	fclose(data->spool);
+	data->spool = nullptr;
+	if(!remove_files)
+		return;
+	remove((data->spoolpath + ".part").c_str());
+	remove((data->spoolpath + ".journal").c_str());
+}
+
+/* asks the server if a spool that was completed earlier still has the current content,
+ * the one byte range is only honoured if the ETag didn't change */
+static Result i_spool_revalidate(get_url_func get_url, cia_net_data *data, bool& valid)
+{
+	u32 status = 0;
+	httpcContext ctx;
+	char crange[64];
+	std::string url;
+	char *total;
+	Result res;
+
+	if((url = get_url(res)) == "")
+		return res;
+	if(R_FAILED(res = i_open_request(url, &ctx, i_range_header(0, 1), &status, data->etag)))
+		return res;
+	valid = false;
+	/* Content-Range: bytes 0-0/<total>, without an ETag the size is all we can go by */
+	if(status == 206 && R_SUCCEEDED(httpcGetResponseHeader(&ctx, "Content-Range", crange, sizeof(crange))))
+	{
+		crange[sizeof(crange) - 1] = '\0';
+		valid = (total = strrchr(crange, '/')) != nullptr && strtoul(total + 1, nullptr, 10) == data->totalSize;
+	}
+	if(!valid) ilog("spooled data is outdated (status %lu), starting over", status);
+	httpcCancelConnection(&ctx);
+	httpcCloseContext(&ctx);
+	return 0;
+}
+
+/* downloads the rest of meta to the spool opened with i_spool_open(),
+ * extra is the amount of SD space needed after the download */
+static Result i_spool_download(const hsapi::FullTitle& meta, get_url_func get_url, prog_func prog, cia_net_data *data, u64 extra)
+{
+	u64 freeSpace = 0;
+	Result res;
+
+	/* a complete spool is only installed if the server still has the same content */
+	if(data->totalSize != 0 && data->received == data->totalSize)
+	{
+		bool valid;
+		if(R_FAILED(res = i_spool_revalidate(get_url, data, valid)))
+			return res;
+		if(valid) return 0;
+		i_spool_reset(data);
+	}
+
+	if(R_FAILED(res = ctr::get_free_space(ctr::DEST_Sdmc, &freeSpace)))
+		return res;
+	if(meta.size - data->received + extra > freeSpace)
+		return APPERR_NOSPACE;
+
+	/* the look-ahead only has the start of the cia */
+	if(data->ahead != nullptr && data->received != 0)
+	{
+		i_lookahead_discard(*data->ahead);
+		data->ahead = nullptr;
+	}
+
+	data->type = ActionType::spool;
+	aptSetHomeAllowed(false);
+	res = i_install_resume_loop(get_url, prog, data);
+	aptSetHomeAllowed(true);
+	i_spool_checkpoint(*data);
+	/* the network is idle while the title is installed from the spool */
+	if(R_SUCCEEDED(res))
+		i_lookahead_start();
+	return res;
+}
+
+/* downloads meta to the spool first and installs it from there */
+static Result i_install_spooled(const hsapi::FullTitle& meta, get_url_func get_url, prog_func prog, bool reinstallable, cia_net_data *data)
+{
+	Result res;
+
+	if(!i_spool_open(meta.id, data))
+	{
+		elog("failed to open spool for %llu, installing directly", meta.id);
+		return net_cia_impl(get_url, meta.tid, reinstallable, prog, data);
+	}
+
+	/* the title itself is on the SD most of the time too */
+	if(R_FAILED(res = i_spool_download(meta, get_url, prog, data, ctr::detect_dest(meta.tid) == ctr::DEST_Sdmc ? meta.size : 0)))
+		goto keep;
+
+	data->type = ActionType::install;
+	res = net_cia_impl(get_url, meta.tid, reinstallable, prog, data);
+	/* we can try again later without downloading everything again */
+	if(res == APPERR_NOREINSTALL || res == APPERR_CANCELLED)
+		goto keep;
+
+	i_spool_close(data, true);
+	return res;
+
+keep:
+	i_spool_close(data, false);
+	return res;
+}
+
+/* downloads the file forwarder meta to the spool and installs the file from there */
+static Result i_install_spooled_forwarder(const hsapi::FullTitle& meta, get_url_func get_url, prog_func prog, cia_net_data *data)
+{
+	Result res;
+
+	if(!i_spool_open(meta.id, data))
+	{
+		elog("failed to open spool for %llu", meta.id);
+		return APPERR_SPOOL_FAIL;
+	}
+
+	/* the forwarded file is at most as large as the cia */
+	if(R_FAILED(res = i_spool_download(meta, get_url, prog, data, meta.size)))
+	{
+		i_spool_close(data, false);
+		return res;
+	}
+
+	/* nnc opens the spool itself */
+	i_spool_close(data, false);
+	res = install_forwarder((data->spoolpath + ".part").c_str());
+	remove((data->spoolpath + ".part").c_str());
+	remove((data->spoolpath + ".journal").c_str());
+	return res;
+}
+
 static Result i_install_hs_cia(const hsapi::FullTitle& meta, prog_func prog, bool reinstallable, cia_net_data *data, bool isKtrHint = false)
 {
 	ctr::Destination media = ctr::detect_dest(meta.tid);
@@ -416,12 +1363,37 @@ static Result i_install_hs_cia(const hsapi::FullTitle& meta, prog_func prog, boo
 	if(!isNew && (isKtrHint || meta.prod.rfind("KTR-", 0) == 0))
 		return APPERR_NOSUPPORT;
 
-	return net_cia_impl([meta](Result& res) -> std::string {
+	get_url_func get_url = [meta](Result& res) -> std::string {
 		std::string ret;
 		if(R_FAILED(res = hsapi::get_download_link(ret, meta)))
 			return "";
 		return ret;
-	}, meta.tid, reinstallable, prog, data);
+	};
+
+	data->ahead = i_lookahead_take(meta.id);
+	if(data->type == ActionType::spool)
+		res = i_install_spooled_forwarder(meta, get_url, prog, data);
+	else if(data->type == ActionType::install && ISET_SPOOL_DOWNLOADS)
+		res = i_install_spooled(meta, get_url, prog, reinstallable, data);
+	else
+		res = net_cia_impl(get_url, meta.tid, reinstallable, prog, data);
+	/* we never got to the download */
+	if(data->ahead != nullptr)
+		i_lookahead_discard(*data->ahead);
+	return res;
+}
+
+void install::set_lookahead(const hsapi::FullTitle *next)
+{
+	g_lookahead_armed = next != nullptr;
+	if(next != nullptr)
+		g_lookahead_next = *next;
+}
+
+void install::drop_lookahead()
+{
+	g_lookahead_armed = false;
+	i_lookahead_discard(g_lookahead);
 }
 
 Result install::net_cia(get_url_func get_url, u64 tid, prog_func prog, bool reinstallable)
@@ -437,15 +1409,24 @@ Result install::hs_cia(const hsapi::FullTitle& meta, prog_func prog, bool reinst
 	/* we instead want to use the theme installer installation method */
 	if(meta.flags & hsapi::TitleFlag::installer)
 	{
+		/* large forwarders are kept on the SD instead of in memory */
+		if(meta.size > FORWARDER_MEM_MAX)
+		{
+			ilog("installing installer content through the spool");
+			data.type = ActionType::spool;
+			return i_install_hs_cia(meta, prog, reinstallable, &data);
+		}
 		ilog("installing installer content");
 		content_type content;
+		/* fail before downloading anything if it won't fit anyway */
+		if(!i_content_reserve(content, meta.size))
+			return APPERR_OUT_OF_MEM;
 		data.content = &content;
 		data.type = ActionType::download;
 		Result res;
 		if(R_FAILED(res = i_install_hs_cia(meta, prog, reinstallable, &data)))
 			return res;
-		/* trust me this'll be fine */
-		return install_forwarder((u8 *) content.c_str(), content.size());
+		return install_forwarder(content.data, content.size);
 	}
 	ilog("installing normal content");
 	data.type = ActionType::install;
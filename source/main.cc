@@ -23,6 +23,8 @@
 #include <widgets/konami.hh>
 #include <widgets/meta.hh>
 
+#include <hlink/http.hh>
+
 #include "audio/configuration.h"
 #include "audio/cwav_reader.h"
 #include "audio/player.h"
@@ -30,6 +32,7 @@
 #include "installgui.hh"
 #include "settings.hh"
 #include "log_view.hh"
+#include "titledb.hh"
 #include "extmeta.hh"
 #include "update.hh"
 #include "search.hh"
@@ -336,6 +339,8 @@ int main(int argc, char* argv[])
 		panic(STRING(fail_init_networking));
 	}
 	atexit(hsapi::global_deinit);
+	titledb::init();
+	hlink::init_file_cache();
 
 #ifdef RELEASE
 	// If we updated ...
@@ -0,0 +1,287 @@
+/* This file is part of 3hs
+ * Copyright (C) 2021-2022 hShop developer team
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "netcache.hh"
+
+#include <unordered_map>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "log.hh"
+
+#define CACHE_DIR "/3ds/3hs/cache/"
+
+/* maximum total size of the cache on the SD in bytes */
+#ifndef NETCACHE_MAX_SIZE
+	#define NETCACHE_MAX_SIZE 0x800000
+#endif
+/* entries younger than this many milliseconds are used without asking the server */
+#ifndef NETCACHE_TTL
+	#define NETCACHE_TTL (60 * 60 * 1000)
+#endif
+
+/* every entry is a file named after the hash of its url containing
+ * this header, the url, the etag, the last-modified date and the body */
+typedef struct cache_header
+{
+	char magic[4]; // "3HSC"
+	u32 bodylen;
+	u64 fetched;
+	u64 lastused;
+	u16 urllen;
+	u16 etaglen;
+	u16 lastmodlen;
+	u16 reserved;
+} cache_header;
+
+typedef struct cache_meta
+{
+	u64 lastused;
+	u32 size;
+} cache_meta;
+
+/* file name -> meta, loaded the first time the cache is used */
+static std::unordered_map<std::string, cache_meta> g_entries;
+static u64 g_totalSize = 0;
+static bool g_loaded = false;
+static LightLock g_lock;
+
+
+static std::string entry_name(const std::string& url)
+{
+	/* FNV-1a */
+	u64 hash = 0xCBF29CE484222325ULL;
+	for(char c : url)
+		hash = (hash ^ (u8) c) * 0x100000001B3ULL;
+	char name[17];
+	snprintf(name, sizeof(name), "%016llX", hash);
+	return name;
+}
+
+static std::string entry_path(const std::string& name)
+{
+	return CACHE_DIR + name;
+}
+
+/* returns true if name could have been made by entry_name() */
+static bool is_entry_name(const char *name)
+{
+	size_t i;
+	for(i = 0; name[i] != '\0'; ++i)
+		if(!((name[i] >= '0' && name[i] <= '9') || (name[i] >= 'A' && name[i] <= 'F')))
+			return false;
+	return i == 16;
+}
+
+static void load_entries()
+{
+	cache_header header;
+	struct dirent *ent;
+	DIR *d;
+	FILE *f;
+
+	g_loaded = true;
+	mkdir("/3ds", 0777);
+	mkdir("/3ds/3hs", 0777);
+	mkdir(CACHE_DIR, 0777);
+	if(!(d = opendir(CACHE_DIR)))
+		return;
+
+	while((ent = readdir(d)))
+	{
+		/* whatever else is in the directory isn't ours to remove */
+		if(!is_entry_name(ent->d_name))
+			continue;
+		if(!(f = fopen(entry_path(ent->d_name).c_str(), "rb")))
+			continue;
+		bool valid = fread(&header, sizeof(header), 1, f) == 1 && memcmp(header.magic, "3HSC", 4) == 0;
+		fclose(f);
+		if(!valid)
+		{
+			wlog("removing invalid cache entry %s", ent->d_name);
+			remove(entry_path(ent->d_name).c_str());
+			continue;
+		}
+		cache_meta& meta = g_entries[ent->d_name];
+		meta.lastused = header.lastused;
+		meta.size = sizeof(header) + header.urllen + header.etaglen + header.lastmodlen + header.bodylen;
+		g_totalSize += meta.size;
+	}
+
+	closedir(d);
+	ilog("loaded %u cached responses, 0x%llX bytes", g_entries.size(), g_totalSize);
+}
+
+static void remove_entry(const std::string& name)
+{
+	std::unordered_map<std::string, cache_meta>::iterator it = g_entries.find(name);
+	if(it == g_entries.end()) return;
+	g_totalSize -= it->second.size;
+	g_entries.erase(it);
+	remove(entry_path(name).c_str());
+}
+
+/* removes the least recently used entries until there is room for size more bytes */
+static void evict(u32 size)
+{
+	while(g_entries.size() != 0 && g_totalSize + size > NETCACHE_MAX_SIZE)
+	{
+		std::unordered_map<std::string, cache_meta>::iterator oldest = g_entries.begin();
+		for(std::unordered_map<std::string, cache_meta>::iterator it = g_entries.begin(); it != g_entries.end(); ++it)
+			if(it->second.lastused < oldest->second.lastused)
+				oldest = it;
+		dlog("evicting cached response %s", oldest->first.c_str());
+		std::string name = oldest->first;
+		remove_entry(name);
+	}
+}
+
+static bool read_string(FILE *f, std::string& str, u32 len)
+{
+	str.resize(len);
+	return len == 0 || fread(&str[0], len, 1, f) == 1;
+}
+
+/* rewrites the header of the opened entry f */
+static void write_header(FILE *f, const cache_header& header)
+{
+	if(fseek(f, 0, SEEK_SET) == 0)
+		fwrite(&header, sizeof(header), 1, f);
+}
+
+bool netcache::lookup(const std::string& url, netcache::entry& ent)
+{
+	std::string name = entry_name(url), curl;
+	cache_header header;
+	bool ret = false;
+	FILE *f = NULL;
+
+	LightLock_Lock(&g_lock);
+	if(!g_loaded) load_entries();
+	if(g_entries.find(name) == g_entries.end())
+		goto out;
+
+	if(!(f = fopen(entry_path(name).c_str(), "r+b")))
+		goto out;
+	if(fread(&header, sizeof(header), 1, f) != 1 || !read_string(f, curl, header.urllen))
+		goto out;
+	/* a hash collision, the new response will replace it */
+	if(curl != url)
+		goto out;
+	if(!read_string(f, ent.etag, header.etaglen) || !read_string(f, ent.lastmod, header.lastmodlen)
+			|| !read_string(f, ent.body, header.bodylen))
+	{
+		elog("cached response for %s is corrupt", url.c_str());
+		fclose(f);
+		f = NULL;
+		remove_entry(name);
+		goto out;
+	}
+	ent.fetched = header.fetched;
+
+	header.lastused = osGetTime();
+	g_entries[name].lastused = header.lastused;
+	write_header(f, header);
+	ret = true;
+
+out:
+	if(f) fclose(f);
+	LightLock_Unlock(&g_lock);
+	dlog("cache %s for %s", ret ? "hit" : "miss", url.c_str());
+	return ret;
+}
+
+void netcache::init()
+{
+	LightLock_Init(&g_lock);
+}
+
+void netcache::store(const std::string& url, netcache::entry& ent)
+{
+	std::string name = entry_name(url);
+	cache_header header;
+	FILE *f;
+
+	/* there's no point in caching what we can't validate or what won't fit */
+	u32 size = sizeof(header) + url.size() + ent.etag.size() + ent.lastmod.size() + ent.body.size();
+	if((ent.etag.size() == 0 && ent.lastmod.size() == 0) || size > NETCACHE_MAX_SIZE
+			|| url.size() > 0xFFFF || ent.etag.size() > 0xFFFF || ent.lastmod.size() > 0xFFFF)
+		return;
+
+	memcpy(header.magic, "3HSC", 4);
+	header.bodylen = ent.body.size();
+	header.fetched = header.lastused = ent.fetched = osGetTime();
+	header.urllen = url.size();
+	header.etaglen = ent.etag.size();
+	header.lastmodlen = ent.lastmod.size();
+	header.reserved = 0;
+
+	LightLock_Lock(&g_lock);
+	if(!g_loaded) load_entries();
+	remove_entry(name);
+	evict(size);
+
+	if(!(f = fopen(entry_path(name).c_str(), "wb")))
+	{
+		elog("failed to open cache entry for %s", url.c_str());
+		goto out;
+	}
+	if(fwrite(&header, sizeof(header), 1, f) != 1 || fwrite(url.data(), url.size(), 1, f) != 1
+		|| (ent.etag.size() != 0 && fwrite(ent.etag.data(), ent.etag.size(), 1, f) != 1)
+		|| (ent.lastmod.size() != 0 && fwrite(ent.lastmod.data(), ent.lastmod.size(), 1, f) != 1)
+		|| (ent.body.size() != 0 && fwrite(ent.body.data(), ent.body.size(), 1, f) != 1))
+	{
+		elog("failed to write cache entry for %s", url.c_str());
+		fclose(f);
+		remove(entry_path(name).c_str());
+		goto out;
+	}
+	fclose(f);
+
+	g_entries[name] = { header.lastused, size };
+	g_totalSize += size;
+	dlog("cached 0x%lX bytes for %s", size, url.c_str());
+
+out:
+	LightLock_Unlock(&g_lock);
+}
+
+void netcache::revalidated(const std::string& url, netcache::entry& ent)
+{
+	std::string name = entry_name(url);
+	cache_header header;
+	FILE *f;
+
+	ent.fetched = osGetTime();
+	LightLock_Lock(&g_lock);
+	if((f = fopen(entry_path(name).c_str(), "r+b")))
+	{
+		if(fread(&header, sizeof(header), 1, f) == 1)
+		{
+			header.fetched = header.lastused = ent.fetched;
+			write_header(f, header);
+		}
+		fclose(f);
+	}
+	LightLock_Unlock(&g_lock);
+}
+
+bool netcache::fresh(const netcache::entry& ent)
+{
+	return osGetTime() - ent.fetched < NETCACHE_TTL;
+}
@@ -72,6 +72,16 @@ const std::string *next::sel_cat(size_t *cursor)
 	return ret;
 }
 
+/* the hovered subcategory is the most likely to be opened, then its neighbours */
+static void prefetch_around(const hsapi::Category& cat, size_t i)
+{
+	std::vector<std::string> scats;
+	scats.push_back(cat.subcategories[i].name);
+	if(i + 1 < cat.subcategories.size()) scats.push_back(cat.subcategories[i + 1].name);
+	if(i > 0) scats.push_back(cat.subcategories[i - 1].name);
+	hsapi::prefetch_titles_in(cat.name, scats);
+}
+
 const std::string *next::sel_sub(const std::string& cat, size_t *cursor, bool visited)
 {
 	using list_t = ui::List<hsapi::Subcategory>;
@@ -101,8 +111,9 @@ const std::string *next::sel_sub(const std::string& cat, size_t *cursor, bool vi
 			if(kDown & KEY_START) ret = next_sub_exit;
 			return false;
 		})
-		.connect(list_t::change, [meta](list_t *self, size_t i) -> void {
+		.connect(list_t::change, [meta, rcat](list_t *self, size_t i) -> void {
 			meta->set_sub(self->at(i));
+			prefetch_around(*rcat, i);
 		})
 		.connect(list_t::buttons, KEY_B | KEY_START)
 		.x(5.0f).y(25.0f)
@@ -133,6 +144,7 @@ const std::string *next::sel_sub(const std::string& cat, size_t *cursor, bool vi
 			}
 		}
 	}
+	prefetch_around(*rcat, list->get_pos());
 	queue.render_finite();
 	if(cursor != nullptr) *cursor = list->get_pos();
 
@@ -141,67 +153,78 @@ const std::string *next::sel_sub(const std::string& cat, size_t *cursor, bool vi
 	return ret;
 }
 
-template <typename T>
-using sort_callback = bool (*) (T& a, T& b);
-
-static bool string_case_cmp(const std::string& a, const std::string& b, bool lt)
+/* the columns titles can be sorted on, stored next to each other so sorting only
+ * has to move indices around instead of whole titles */
+class title_columns
 {
-	for(size_t i = 0; i < a.size() && i < b.size(); ++i)
+public:
+	title_columns(const std::vector<hsapi::Title>& titles)
 	{
-		char cha = tolower(a[i]), chb = tolower(b[i]);
-		if(cha == chb) continue;
-		return lt ? cha < chb : cha > chb;
+		size_t n = titles.size();
+		this->names.reserve(n);
+		this->tids.reserve(n);
+		this->sizes.reserve(n);
+		this->downloads.reserve(n);
+		this->ids.reserve(n);
+		this->order.reserve(n);
+		for(size_t i = 0; i < n; ++i)
+		{
+			const hsapi::Title& title = titles[i];
+			/* casefolded once here instead of for every comparison */
+			this->names.emplace_back(title.name);
+			for(char& c : this->names.back())
+				c = tolower(c);
+			this->tids.push_back(title.tid);
+			this->sizes.push_back(title.size);
+			this->downloads.push_back(title.dlCount);
+			this->ids.push_back(title.id);
+			this->order.push_back(i);
+		}
 	}
-	return lt ? a.size() < b.size() : a.size() > b.size();
-}
-
-static bool sort_alpha_desc(hsapi::Title& a, hsapi::Title& b) { return string_case_cmp(a.name, b.name, false); }
-static bool sort_tid_desc(hsapi::Title& a, hsapi::Title& b) { return a.tid > b.tid; }
-static bool sort_size_desc(hsapi::Title& a, hsapi::Title& b) { return a.size > b.size; }
-static bool sort_downloads_desc(hsapi::Title& a, hsapi::Title& b) { return a.dlCount > b.dlCount; }
-static bool sort_id_desc(hsapi::Title& a, hsapi::Title& b) { return a.id > b.id; }
-
-static bool sort_alpha_asc(hsapi::Title& a, hsapi::Title& b) { return string_case_cmp(a.name, b.name, true); }
-static bool sort_tid_asc(hsapi::Title& a, hsapi::Title& b) { return a.tid < b.tid; }
-static bool sort_size_asc(hsapi::Title& a, hsapi::Title& b) { return a.size < b.size; }
-static bool sort_downloads_asc(hsapi::Title& a, hsapi::Title& b) { return a.dlCount < b.dlCount; }
-static bool sort_id_asc(hsapi::Title& a, hsapi::Title& b) { return a.id < b.id; }
 
-static sort_callback<hsapi::Title> get_sort_callback(SortDirection dir, SortMethod method)
-{
-	switch(dir)
+	void sort(SortDirection dir, SortMethod method)
 	{
-	case SortDirection::ascending:
 		switch(method)
 		{
-		case SortMethod::alpha: return sort_alpha_asc;
-		case SortMethod::tid: return sort_tid_asc;
-		case SortMethod::size: return sort_size_asc;
-		case SortMethod::downloads: return sort_downloads_asc;
-		case SortMethod::id: return sort_id_asc;
+		case SortMethod::alpha: this->sort_on(this->names, dir); return;
+		case SortMethod::tid: this->sort_on(this->tids, dir); return;
+		case SortMethod::size: this->sort_on(this->sizes, dir); return;
+		case SortMethod::downloads: this->sort_on(this->downloads, dir); return;
+		case SortMethod::id: this->sort_on(this->ids, dir); return;
 		}
-		break;
-	case SortDirection::descending:
-		switch(method)
-		{
-		case SortMethod::alpha: return sort_alpha_desc;
-		case SortMethod::tid: return sort_tid_desc;
-		case SortMethod::size: return sort_size_desc;
-		case SortMethod::downloads: return sort_downloads_desc;
-		case SortMethod::id: return sort_id_desc;
-		}
-		break;
+		/* how does this happen?! all i know is it does */
+		fix_sort_settings();
+		this->sort_on(this->names, SortDirection::ascending);
 	}
-	/* how does this happen?! all i know is it does */
-	fix_sort_settings();
-	return sort_alpha_asc;
-//	panic("invalid sort method/direction");
-}
+
+	/* indices into the titles, in sorted order */
+	std::vector<size_t> order;
+
+
+private:
+	std::vector<std::string> names;
+	std::vector<hsapi::htid> tids;
+	std::vector<hsapi::hsize> sizes;
+	std::vector<hsapi::hsize> downloads;
+	std::vector<hsapi::hid> ids;
+
+	template <typename T>
+	void sort_on(const std::vector<T>& column, SortDirection dir)
+	{
+		if(dir == SortDirection::descending)
+			std::sort(this->order.begin(), this->order.end(), [&column](size_t a, size_t b) -> bool { return column[a] > column[b]; });
+		else
+			std::sort(this->order.begin(), this->order.end(), [&column](size_t a, size_t b) -> bool { return column[a] < column[b]; });
+	}
+
+
+};
 
 hsapi::hid next::sel_gam(std::vector<hsapi::Title>& titles, size_t *cursor)
 {
 	panic_assert(titles.size() > *cursor, "invalid cursor position");
-	using list_t = ui::List<hsapi::Title>;
+	/* the list shows the sorted indices, titles itself stays in the same order */
+	using list_t = ui::List<size_t>;
 
 	std::string desc = set_desc(STRING(select_title));
 	bool focus = set_focus(false);
@@ -209,20 +232,21 @@ hsapi::hid next::sel_gam(std::vector<hsapi::Title>& titles, size_t *cursor)
 
 	SortDirection dir = SETTING_DEFAULT_SORTDIRECTION;
 	SortMethod sortm = SETTING_DEFAULT_SORTMETHOD;
-	std::sort(titles.begin(), titles.end(), get_sort_callback(dir, sortm));
+	title_columns columns(titles);
+	columns.sort(dir, sortm);
 
 	ui::RenderQueue queue;
 
 	ui::TitleMeta *meta;
 	list_t *list;
 
-	ui::builder<ui::TitleMeta>(ui::Screen::bottom, titles[*cursor])
+	ui::builder<ui::TitleMeta>(ui::Screen::bottom, titles[columns.order[*cursor]])
 		.add_to(&meta, queue);
 
-	ui::builder<list_t>(ui::Screen::top, &titles)
-		.connect(list_t::to_string, [](const hsapi::Title& title) -> std::string { return hsapi::title_name(title); })
-		.connect(list_t::select, [&ret](list_t *self, size_t i, u32 kDown) -> bool {
-			ret = self->at(i).id;
+	ui::builder<list_t>(ui::Screen::top, &columns.order)
+		.connect(list_t::to_string, [&titles](const size_t& i) -> std::string { return hsapi::title_name(titles[i]); })
+		.connect(list_t::select, [&ret, &titles](list_t *self, size_t i, u32 kDown) -> bool {
+			ret = titles[self->at(i)].id;
 			if(kDown & KEY_B) ret = next_gam_back;
 			if(kDown & KEY_START) ret = next_gam_exit;
 			if(kDown & KEY_Y)
@@ -235,51 +259,33 @@ hsapi::hid next::sel_gam(std::vector<hsapi::Title>& titles, size_t *cursor)
 			}
 			return false;
 		})
-		.connect(list_t::change, [meta](list_t *self, size_t i) -> void {
-			meta->set_title(self->at(i));
+		.connect(list_t::change, [meta, &titles](list_t *self, size_t i) -> void {
+			meta->set_title(titles[self->at(i)]);
 		})
 		.connect(list_t::buttons, KEY_B | KEY_Y | KEY_START)
 		.x(5.0f).y(25.0f)
 		.add_to(&list, queue);
 
 	ui::builder<ui::ButtonCallback>(ui::Screen::top, KEY_L)
-		.connect(ui::ButtonCallback::kdown, [list, &dir, &sortm, &titles, meta](u32) -> bool {
-			ui::RenderQueue::global()->render_and_then([list, &dir, &sortm, &titles, meta]() -> void {
+		.connect(ui::ButtonCallback::kdown, [list, &dir, &sortm, &titles, &columns, meta](u32) -> bool {
+			ui::RenderQueue::global()->render_and_then([list, &dir, &sortm, &titles, &columns, meta]() -> void {
 				sortm = settings_sort_switch();
-#if 0
-				hsapi::hid curId = titles[list->get_pos()].id;
-#endif
-				std::sort(titles.begin(), titles.end(), get_sort_callback(dir, sortm));
+				columns.sort(dir, sortm);
 				list->update();
-#if 0
-				auto it = std::find(titles.begin(), titles.end(), curId);
-				panic_assert(it != titles.end(), "failed to find previously selected title");
-				list->set_pos(it - titles.begin());
-				meta->set_title(*it);
-#endif
 				list->set_pos(0);
-				meta->set_title(titles[0]);
+				meta->set_title(titles[columns.order[0]]);
 			});
 			return true;
 		}).add_to(queue);
 
 	ui::builder<ui::ButtonCallback>(ui::Screen::top, KEY_R)
-		.connect(ui::ButtonCallback::kdown, [list, &dir, &sortm, &titles, meta](u32) -> bool {
-			ui::RenderQueue::global()->render_and_then([list, &dir, &sortm, &titles, meta]() -> void {
+		.connect(ui::ButtonCallback::kdown, [list, &dir, &sortm, &titles, &columns, meta](u32) -> bool {
+			ui::RenderQueue::global()->render_and_then([list, &dir, &sortm, &titles, &columns, meta]() -> void {
 				dir = dir == SortDirection::ascending ? SortDirection::descending : SortDirection::ascending;
-#if 0
-				hsapi::hid curId = titles[list->get_pos()].id;
-#endif
-				std::sort(titles.begin(), titles.end(), get_sort_callback(dir, sortm));
+				columns.sort(dir, sortm);
 				list->update();
-#if 0
-				auto it = std::find(titles.begin(), titles.end(), curId);
-				panic_assert(it != titles.end(), "failed to find previously selected title");
-				list->set_pos(it - titles.begin());
-				meta->set_title(*it);
-#endif
 				list->set_pos(0);
-				meta->set_title(titles[0]);
+				meta->set_title(titles[columns.order[0]]);
 			});
 			return true;
 		}).add_to(queue);
@@ -55,6 +55,19 @@ void queue_add(hsapi::hid id, bool disp)
 	queue_add(meta);
 }
 
+void queue_add(const std::vector<hsapi::hid>& ids)
+{
+	std::vector<hsapi::FullTitle> metas;
+	std::vector<hsapi::hid> missing;
+	for(hsapi::hid id : ids)
+		if(std::find(g_queue.begin(), g_queue.end(), id) == g_queue.end())
+			missing.push_back(id);
+	/* titles that failed are skipped, like they would be when added one by one */
+	hsapi::title_meta_batch(metas, missing);
+	for(const hsapi::FullTitle& meta : metas)
+		queue_add(meta);
+}
+
 void queue_remove(size_t index)
 {
 	g_queue.erase(g_queue.begin() + index);
@@ -94,6 +107,7 @@ void queue_process_all()
 	for(i = 0; i < g_queue.size(); ++i)
 	{
 		ilog("Processing title with id=%llu", g_queue[i].id);
+		install::set_lookahead(i + 1 < g_queue.size() ? &g_queue[i + 1] : nullptr);
 		res = install::gui::hs_cia(g_queue[i], false, false, PSTRING(installing_game_x_of_y,
 			hsapi::title_name(g_queue[i]), i + 1, g_queue.size()));
 		ilog("Finished processing, res=%016lX", res);
@@ -116,6 +130,8 @@ void queue_process_all()
 		}
 	}
 
+	install::drop_lookahead();
+
 	if(procflag & SET_PATCH) luma::maybe_set_gamepatching();
 	if(procflag & WARN_THEME) ui::notice(STRING(theme_installed));
 	if(procflag & WARN_FILE) ui::notice(STRING(file_installed));
@@ -819,13 +819,15 @@ static bool show_normal_search()
 					/* we may need to post-process the regions */
 					if(tabIndex == 0)
 					{
+						/* interned once so the checks below are pointer compares */
+						const hsapi::hcat na = CAT_NA, eur = CAT_EUR, jpn = CAT_JPN;
 						if(!reg_other->checked()) /* include mode */
 							vec_erase_if<hsapi::Title>(titles, [&](const hsapi::Title& title) -> bool {
-								return (reg_usa->checked() && title.subcat != CAT_NA) || (reg_eur->checked() && title.subcat != CAT_EUR) || (reg_jpn->checked() && title.subcat != CAT_JPN);
+								return (reg_usa->checked() && title.subcat != na) || (reg_eur->checked() && title.subcat != eur) || (reg_jpn->checked() && title.subcat != jpn);
 							});
 						else if(!(/* reg_other->checked() && */ reg_usa->checked() && reg_eur->checked() && reg_jpn->checked())) /* exclude mode */
 							vec_erase_if<hsapi::Title>(titles, [&](const hsapi::Title& title) -> bool {
-								return (!reg_usa->checked() && title.subcat == CAT_NA) || (!reg_eur->checked() && title.subcat == CAT_EUR) || (!reg_jpn->checked() && title.subcat == CAT_JPN);
+								return (!reg_usa->checked() && title.subcat == na) || (!reg_eur->checked() && title.subcat == eur) || (!reg_jpn->checked() && title.subcat == jpn);
 							});
 					}
 					if(titles.size())
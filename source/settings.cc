@@ -362,6 +362,8 @@ enum SettingsId
 	ID_ShowAlt,    // bool
 	ID_DisGraph,   // bool
 	ID_GotoRegion, // bool
+	ID_Parallel,   // bool
+	ID_Spool,      // bool
 	ID_TimeFmt,    // show as text: enum val
 	ID_ProgLoc,    // show as text: enum val
 	ID_Language,   // show as text: enum val
@@ -472,6 +474,10 @@ static bool serialize_id_bool(SettingsId ID)
 		return ISET_DISABLE_GRAPH;
 	case ID_GotoRegion:
 		return ISET_GOTO_REGION;
+	case ID_Parallel:
+		return ISET_PARALLEL_DOWNLOADS;
+	case ID_Spool:
+		return ISET_SPOOL_DOWNLOADS;
 	case ID_TimeFmt:
 	case ID_ProgLoc:
 	case ID_Language:
@@ -500,6 +506,8 @@ static std::string serialize_id_text(SettingsId ID)
 	case ID_ShowAlt:
 	case ID_DisGraph:
 	case ID_GotoRegion:
+	case ID_Parallel:
+	case ID_Spool:
 		panic("impossible text setting switch case reached");
 	case ID_TimeFmt:
 		return ISET_BAD_TIME_FORMAT ? STRING(fmt_12h) : STRING(fmt_24h);
@@ -750,6 +758,12 @@ static void update_settings_ID(SettingsId ID)
 	case ID_GotoRegion:
 		g_nsettings.flags0 ^= FLAG0_GOTO_REGION;
 		break;
+	case ID_Parallel:
+		g_nsettings.flags0 ^= FLAG0_PARALLEL_DOWNLOADS;
+		break;
+	case ID_Spool:
+		g_nsettings.flags0 ^= FLAG0_SPOOL_DOWNLOADS;
+		break;
 	// Enums
 	case ID_TimeFmt:
 	{
@@ -853,14 +867,17 @@ void log_settings()
 		"defaultSortDirection: %s, "
 		"proxyEnabled: %s, "
 		"themePath: %s, "
-		"disableGraph: %s",
+		"disableGraph: %s, "
+		"parallelDownloads: %s, "
+		"spoolDownloads: %s",
 			BOOL(ISET_RESUME_DOWNLOADS), BOOL(ISET_LOAD_FREE_SPACE),
 			BOOL(ISET_SHOW_BATTERY), BOOL(ISET_SHOW_NET), BOOL(ISET_BAD_TIME_FORMAT),
 			ISET_PROGBAR_TOP ? "top" : "bottom",
 			i18n::langname(g_nsettings.lang), localemode2str_en(SETTING_LUMALOCALE),
 			BOOL(ISET_SEARCH_ECONTENT), BOOL(ISET_WARN_NO_BASE), g_nsettings.max_elogs,
 			method2str_en(SETTING_DEFAULT_SORTMETHOD), direction2str_en(SETTING_DEFAULT_SORTDIRECTION),
-			BOOL(g_nsettings.proxy_port != 0), g_nsettings.theme_path.c_str(), BOOL(ISET_DISABLE_GRAPH));
+			BOOL(g_nsettings.proxy_port != 0), g_nsettings.theme_path.c_str(), BOOL(ISET_DISABLE_GRAPH),
+			BOOL(ISET_PARALLEL_DOWNLOADS), BOOL(ISET_SPOOL_DOWNLOADS));
 #undef BOOL
 }
 
@@ -893,6 +910,8 @@ void show_settings()
 		{ STRING(show_alt)       , STRING(show_alt_desc)       , ID_ShowAlt    , false },
 		{ STRING(disable_graph)  , STRING(disable_graph_desc)  , ID_DisGraph   , false },
 		{ STRING(goto_region)    , STRING(goto_region_desc)    , ID_GotoRegion , false },
+		{ STRING(parallel_dl)    , STRING(parallel_dl_desc)    , ID_Parallel   , false },
+		{ STRING(spool_dl)       , STRING(spool_dl_desc)       , ID_Spool      , false },
 		{ STRING(time_format)    , STRING(time_format_desc)    , ID_TimeFmt    , true  },
 		{ STRING(progbar_screen) , STRING(progbar_screen_desc) , ID_ProgLoc    , true  },
 		{ STRING(language)       , STRING(language_desc)       , ID_Language   , true  },
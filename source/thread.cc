@@ -0,0 +1,200 @@
+/* This file is part of 3hs
+ * Copyright (C) 2021-2022 hShop developer team
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "thread.hh"
+#include "log.hh"
+
+#define STACK_SIZE (64 * 1024)
+/* highest and lowest priority an application thread may have */
+#define PRIO_MIN 0x18
+#define PRIO_MAX 0x3F
+
+
+typedef struct ctr::detail::task_state
+{
+	std::function<void()> cb;
+	LightEvent finished;
+	volatile bool done;
+	ctr::pool *owner;
+	s32 prio;
+} task_state;
+
+
+static void run_task(std::shared_ptr<task_state>& state)
+{
+	state->cb();
+	state->cb = nullptr;
+	state->done = true;
+	LightEvent_Signal(&state->finished);
+}
+
+void ctr::task::join()
+{
+	if(!this->state || this->state->done)
+		return;
+	/* if no thread picked up the task yet we run it here, else a task that waits on
+	 * another task could wait forever once every thread of the pool is busy. it gets
+	 * the stack and priority of this thread, not STACK_SIZE and state->prio */
+	if(this->state->owner->claim(this->state))
+		run_task(this->state);
+	else LightEvent_Wait(&this->state->finished);
+}
+
+bool ctr::task::finished()
+{
+	return !this->state || this->state->done;
+}
+
+ctr::pool::pool(int core, size_t max)
+	: idle(0), max(max), core(core)
+{
+	LightSemaphore_Init(&this->pending, 0, 0x7FFF);
+	LightLock_Init(&this->lock);
+}
+
+ctr::pool::~pool()
+{
+	/* an empty task tells a thread to stop */
+	LightLock_Lock(&this->lock);
+	for(size_t i = 0; i < this->threads.size(); ++i)
+		this->queue.emplace_back();
+	LightLock_Unlock(&this->lock);
+	LightSemaphore_Release(&this->pending, this->threads.size());
+	for(Thread th : this->threads)
+	{
+		threadJoin(th, U64_MAX);
+		threadFree(th);
+	}
+}
+
+/* this->lock must be held */
+bool ctr::pool::spawn()
+{
+	s32 prio = 0;
+	svcGetThreadPriority(&prio, CUR_THREAD_HANDLE);
+	Thread th = threadCreate(&pool::entrypoint, this, STACK_SIZE, prio, this->core, false);
+	if(th == nullptr && this->core != -2)
+	{
+		/* the core may not be available to us, try the default one */
+		wlog("failed to create pool thread on core %d", this->core);
+		this->core = -2;
+		th = threadCreate(&pool::entrypoint, this, STACK_SIZE, prio, this->core, false);
+	}
+	if(th == nullptr)
+		return false;
+	this->threads.push_back(th);
+	++this->idle;
+	dlog("pool on core %d now has %u threads", this->core, this->threads.size());
+	return true;
+}
+
+void ctr::pool::entrypoint(void *arg)
+{
+	pool *self = (pool *) arg;
+	std::shared_ptr<task_state> state;
+	size_t best;
+
+	while(true)
+	{
+		LightSemaphore_Acquire(&self->pending, 1);
+		LightLock_Lock(&self->lock);
+		/* the task was claimed by ctr::task::join() */
+		if(self->queue.size() == 0)
+		{
+			LightLock_Unlock(&self->lock);
+			continue;
+		}
+		/* lower numbers mean a higher priority */
+		best = 0;
+		for(size_t i = 1; i < self->queue.size(); ++i)
+			if(self->queue[i] && (!self->queue[best] || self->queue[i]->prio < self->queue[best]->prio))
+				best = i;
+		state = self->queue[best];
+		self->queue.erase(self->queue.begin() + best);
+		if(state) --self->idle;
+		LightLock_Unlock(&self->lock);
+		if(!state) break;
+
+		svcSetThreadPriority(CUR_THREAD_HANDLE, state->prio);
+		run_task(state);
+		state.reset();
+
+		LightLock_Lock(&self->lock);
+		++self->idle;
+		LightLock_Unlock(&self->lock);
+	}
+}
+
+ctr::task ctr::pool::run(std::function<void()> cb, int prioAddition, bool blocking)
+{
+	std::shared_ptr<task_state> state = std::make_shared<task_state>();
+	LightEvent_Init(&state->finished, RESET_STICKY);
+	state->cb = cb;
+	state->done = false;
+	state->owner = this;
+
+	s32 prio = 0;
+	svcGetThreadPriority(&prio, CUR_THREAD_HANDLE);
+	prio += prioAddition;
+	state->prio = prio < PRIO_MIN ? PRIO_MIN : prio > PRIO_MAX ? PRIO_MAX : prio;
+
+	LightLock_Lock(&this->lock);
+	this->queue.push_back(state);
+	/* every queued task needs a thread that is free to pick it up, it may be waited on.
+	 * nobody might wait on a blocking task though, so that can't be relied upon for them */
+	if(this->queue.size() > this->idle && (this->threads.size() < this->max || blocking) && !this->spawn())
+		panic_assert(this->threads.size() != 0, "failed to create thread");
+	LightLock_Unlock(&this->lock);
+	LightSemaphore_Release(&this->pending, 1);
+	return task(state);
+}
+
+bool ctr::pool::claim(const std::shared_ptr<task_state>& state)
+{
+	bool found = false;
+	LightLock_Lock(&this->lock);
+	for(size_t i = 0; i < this->queue.size(); ++i)
+		if(this->queue[i] == state)
+		{
+			this->queue.erase(this->queue.begin() + i);
+			found = true;
+			break;
+		}
+	LightLock_Unlock(&this->lock);
+	return found;
+}
+
+/* the shared pools are never destroyed, a thread stuck in a task would otherwise hang exit() */
+ctr::pool& ctr::pool::global()
+{
+	static pool *p = new pool();
+	return *p;
+}
+
+static int background_core()
+{
+	bool isNew = false;
+	APT_CheckNew3DS(&isNew);
+	/* core 2 is only there on the New 3DS */
+	return isNew ? 2 : -2;
+}
+
+ctr::pool& ctr::pool::background()
+{
+	static pool *p = new pool(background_core());
+	return *p;
+}
+
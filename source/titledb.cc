@@ -0,0 +1,289 @@
+/* This file is part of 3hs
+ * Copyright (C) 2021-2022 hShop developer team
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "titledb.hh"
+
+#include <unordered_map>
+#include <algorithm>
+#include <string.h>
+#include <stdio.h>
+
+#include "ctr.hh"
+#include "log.hh"
+
+#define TITLEDB_PATH "/3ds/3hs/titledb.bin"
+/* titles asked from AM per AM_GetTitleInfo() call when rebuilding */
+#define SCAN_CHUNK 64
+
+/* the database is this header followed by count entries */
+typedef struct titledb_header
+{
+	char magic[4]; // "3HT2", "3HST" databases only stored the title counts
+	u32 count;
+	u64 sdhash; /* fingerprint() of the titles AM reported on the SD when the database was last in sync */
+	u64 nandhash; /* same for the NAND */
+} titledb_header;
+
+typedef struct titledb_entry
+{
+	u64 tid;
+	u16 version;
+	u8 media;
+	u8 reserved[5];
+} titledb_entry;
+
+static std::unordered_map<u64, titledb_entry> g_titles;
+static u64 g_sdhash = 0, g_nandhash = 0;
+static bool g_loaded = false;
+/* the database matched what AM lists since it was loaded. titles only change behind our back
+ * while 3hs isn't running, so after that it's kept in sync by installed() and removed() */
+static bool g_synced = false;
+static LightLock g_lock;
+
+
+static u64& recorded_hash(FS_MediaType media)
+{
+	return media == MEDIATYPE_SD ? g_sdhash : g_nandhash;
+}
+
+/* FNV-1a of the sorted title ids, so a title that replaced another is noticed as well */
+static u64 fingerprint(std::vector<u64>& tids)
+{
+	u64 hash = 0xCBF29CE484222325ULL;
+	std::sort(tids.begin(), tids.end());
+	for(u64 tid : tids)
+		for(size_t i = 0; i < sizeof(tid); ++i)
+			hash = (hash ^ (u8) (tid >> (i * 8))) * 0x100000001B3ULL;
+	return hash;
+}
+
+/* fingerprint() of the titles on media according to the database */
+static u64 recorded_fingerprint(FS_MediaType media)
+{
+	std::vector<u64> tids;
+	for(std::unordered_map<u64, titledb_entry>::iterator it = g_titles.begin(); it != g_titles.end(); ++it)
+		if(it->second.media == media)
+			tids.push_back(it->first);
+	return fingerprint(tids);
+}
+
+static bool load()
+{
+	titledb_header header;
+	titledb_entry entry;
+	bool ret = false;
+	FILE *f;
+
+	if(!(f = fopen(TITLEDB_PATH, "rb")))
+		return false;
+	if(fread(&header, sizeof(header), 1, f) != 1 || memcmp(header.magic, "3HT2", 4) != 0)
+		goto out;
+	g_titles.clear();
+	g_titles.reserve(header.count);
+	for(u32 i = 0; i < header.count; ++i)
+	{
+		if(fread(&entry, sizeof(entry), 1, f) != 1)
+			goto out;
+		g_titles[entry.tid] = entry;
+	}
+	g_sdhash = header.sdhash;
+	g_nandhash = header.nandhash;
+	ret = true;
+
+out:
+	if(!ret) elog("title database is invalid");
+	fclose(f);
+	return ret;
+}
+
+static void save()
+{
+	titledb_header header;
+	bool ok;
+	FILE *f;
+
+	memcpy(header.magic, "3HT2", 4);
+	header.count = g_titles.size();
+	header.sdhash = g_sdhash;
+	header.nandhash = g_nandhash;
+
+	/* written to a temporary file first so the database is never half written */
+	if(!(f = fopen(TITLEDB_PATH ".tmp", "wb")))
+		return;
+	ok = fwrite(&header, sizeof(header), 1, f) == 1;
+	for(std::unordered_map<u64, titledb_entry>::iterator it = g_titles.begin(); ok && it != g_titles.end(); ++it)
+		ok = fwrite(&it->second, sizeof(titledb_entry), 1, f) == 1;
+	fclose(f);
+	if(!ok)
+	{
+		elog("failed to write title database");
+		remove(TITLEDB_PATH ".tmp");
+		return;
+	}
+	remove(TITLEDB_PATH);
+	rename(TITLEDB_PATH ".tmp", TITLEDB_PATH);
+}
+
+/* adds tids, the titles AM listed on media, to the database */
+static Result scan(FS_MediaType media, std::vector<u64>& tids)
+{
+	AM_TitleEntry entries[SCAN_CHUNK];
+	Result res;
+	u32 count;
+
+	for(size_t i = 0; i < tids.size(); i += SCAN_CHUNK)
+	{
+		count = tids.size() - i < SCAN_CHUNK ? tids.size() - i : SCAN_CHUNK;
+		if(R_FAILED(res = AM_GetTitleInfo(media, count, &tids[i], entries)))
+			return res;
+		for(u32 j = 0; j < count; ++j)
+			g_titles[entries[j].titleID] = { entries[j].titleID, entries[j].version, (u8) media, { 0 } };
+	}
+	recorded_hash(media) = fingerprint(tids);
+	return 0;
+}
+
+/* loads the database and rebuilds it if AM lists other titles than it has, g_lock must be held.
+ * listing the titles is cheap-ish, asking AM for the version of every title is what we avoid */
+static Result ensure()
+{
+	std::vector<u64> sdtids, nandtids;
+	Result res;
+
+	if(g_loaded && g_synced)
+		return 0;
+	if(R_FAILED(res = ctr::list_titles_on(MEDIATYPE_SD, sdtids)))
+		return res;
+	if(R_FAILED(res = ctr::list_titles_on(MEDIATYPE_NAND, nandtids)))
+		return res;
+	if(!g_loaded)
+		g_loaded = load();
+	if(g_loaded && fingerprint(sdtids) == g_sdhash && fingerprint(nandtids) == g_nandhash)
+	{
+		g_synced = true;
+		return 0;
+	}
+
+	ilog("rebuilding title database (%u titles on the sd, %u on the nand)", sdtids.size(), nandtids.size());
+	g_titles.clear();
+	g_loaded = false;
+	if(R_FAILED(res = scan(MEDIATYPE_SD, sdtids)) || R_FAILED(res = scan(MEDIATYPE_NAND, nandtids)))
+		return res;
+	g_loaded = g_synced = true;
+	save();
+	return 0;
+}
+
+void titledb::init()
+{
+	LightLock_Init(&g_lock);
+}
+
+Result titledb::list(std::vector<u64>& ret)
+{
+	LightLock_Lock(&g_lock);
+	Result res = ensure();
+	if(R_SUCCEEDED(res))
+	{
+		ret.reserve(ret.size() + g_titles.size());
+		for(std::unordered_map<u64, titledb_entry>::iterator it = g_titles.begin(); it != g_titles.end(); ++it)
+			ret.push_back(it->first);
+	}
+	LightLock_Unlock(&g_lock);
+	/* the game card can change at any time so it isn't stored, and it might error if there is no cart inserted */
+	if(R_SUCCEEDED(res))
+		ctr::list_titles_on(MEDIATYPE_GAME_CARD, ret);
+	return res;
+}
+
+bool titledb::version(u64 tid, u16& ver)
+{
+	LightLock_Lock(&g_lock);
+	std::unordered_map<u64, titledb_entry>::iterator it = g_titles.find(tid);
+	bool found = g_loaded && it != g_titles.end();
+	if(found) ver = it->second.version;
+	LightLock_Unlock(&g_lock);
+	if(found) return true;
+
+	/* game card titles aren't in the database */
+	AM_TitleEntry entry;
+	if(R_FAILED(ctr::get_title_entry(tid, entry)))
+		return false;
+	ver = entry.version;
+	return true;
+}
+
+bool titledb::verify_version(u64 tid, u16& ver)
+{
+	AM_TitleEntry entry;
+	LightLock_Lock(&g_lock);
+	std::unordered_map<u64, titledb_entry>::iterator it = g_titles.find(tid);
+	bool recorded = g_loaded && it != g_titles.end();
+	bool found = R_SUCCEEDED(AM_GetTitleInfo(recorded ? (FS_MediaType) it->second.media : ctr::mediatype_of(tid), 1, &tid, &entry));
+	if(found && recorded && it->second.version != entry.version)
+	{
+		/* updated outside of 3hs, the title ids didn't change so the fingerprint missed it */
+		ilog("title database had version %u of %016llX, but %u is installed", it->second.version, tid, entry.version);
+		it->second.version = entry.version;
+		save();
+	}
+	LightLock_Unlock(&g_lock);
+	if(found) ver = entry.version;
+	return found;
+}
+
+/* applies a change of one title, or marks the database as out of sync if AM
+ * disagrees with the result. g_lock must be held */
+static void update(u64 tid, FS_MediaType media, bool added)
+{
+	std::vector<u64> tids;
+	if(media == MEDIATYPE_GAME_CARD || !g_loaded || R_FAILED(ctr::list_titles_on(media, tids)))
+		return;
+
+	AM_TitleEntry entry;
+	if(added && R_SUCCEEDED(AM_GetTitleInfo(media, 1, &tid, &entry)))
+		g_titles[tid] = { tid, entry.version, (u8) media, { 0 } };
+	else g_titles.erase(tid);
+
+	u64 hash = fingerprint(tids);
+	if(hash != recorded_fingerprint(media))
+	{
+		/* someone else changed titles as well, rebuild next time */
+		ilog("title database out of sync (%u titles)", tids.size());
+		g_loaded = g_synced = false;
+		remove(TITLEDB_PATH);
+		return;
+	}
+	recorded_hash(media) = hash;
+	save();
+}
+
+void titledb::installed(u64 tid, FS_MediaType media)
+{
+	LightLock_Lock(&g_lock);
+	if(!g_loaded) g_loaded = load();
+	update(tid, media, true);
+	LightLock_Unlock(&g_lock);
+}
+
+void titledb::removed(u64 tid, FS_MediaType media)
+{
+	LightLock_Lock(&g_lock);
+	if(!g_loaded) g_loaded = load();
+	update(tid, media, false);
+	LightLock_Unlock(&g_lock);
+}
+
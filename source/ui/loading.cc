@@ -53,6 +53,29 @@ void ui::loading(std::function<void()> callback)
 	::set_desc(desc);
 }
 
+void ui::loading_until(std::function<bool()> done)
+{
+	std::string desc = ::set_desc(STRING(loading));
+	bool focus = ::set_focus(true);
+
+	aptSetHomeAllowed(false);
+	{
+		ui::RenderQueue queue;
+		ui::builder<ui::Spinner>(ui::Screen::top)
+			.x(ui::layout::center_x)
+			.y(ui::layout::center_y)
+			.add_to(queue);
+
+		ui::Keys keys;
+		while(!done() && queue.render_frame((keys = ui::RenderQueue::get_keys())))
+			/* no-op */ ;
+	}
+	aptSetHomeAllowed(true);
+
+	::set_focus(focus);
+	::set_desc(desc);
+}
+
 static std::string loadingbar_serialize(u64 cur, u64 total)
 {
 	(void) total;
@@ -0,0 +1,133 @@
+/* This file is part of 3hs
+ * Copyright (C) 2021-2022 hShop developer team
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* checks content_type and compares it with appending to a std::basic_string, which
+ * is what the download path did before. every case runs in its own process so
+ * ru_maxrss is the peak of that case alone */
+
+#include <content.hh>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+#include <stdio.h>
+
+#define CHUNK 0x10000
+
+static int failures = 0;
+
+#define CHECK(cond) \
+	if(!(cond)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); ++failures; }
+
+static void test_content()
+{
+	uint8_t chunk[100];
+	for(size_t i = 0; i < sizeof(chunk); ++i)
+		chunk[i] = i;
+
+	content_type content;
+	CHECK(content.reserve(250));
+	CHECK(content.capacity == 250);
+	uint8_t *data = content.data;
+	CHECK(content.append(chunk, 100, 250));
+	CHECK(content.append(chunk, 100, 250));
+	CHECK(content.append(chunk, 50, 250));
+	/* everything fit in what was reserved */
+	CHECK(content.data == data && content.capacity == 250 && content.size == 250);
+	CHECK(content.data[199] == 99 && content.data[249] == 49);
+
+	/* the server sent more than announced */
+	CHECK(content.append(chunk, 100, 250));
+	CHECK(content.size == 350 && content.capacity == 350);
+	CHECK(content.data[349] == 99);
+
+	/* growing to what's still expected instead of just the chunk */
+	content_type unsized;
+	CHECK(unsized.append(chunk, 10, 1000));
+	CHECK(unsized.capacity == 1000 && unsized.size == 10);
+}
+
+typedef bool (*bench_case)(uint32_t total);
+
+static bool run_content(uint32_t total)
+{
+	static uint8_t chunk[CHUNK];
+	content_type content;
+	if(!content.reserve(total)) return false;
+	for(uint32_t i = 0; i < total; i += CHUNK)
+		if(!content.append(chunk, CHUNK, total)) return false;
+	return content.size == total;
+}
+
+static bool run_string(uint32_t total)
+{
+	static uint8_t chunk[CHUNK];
+	std::basic_string<uint8_t> content;
+	for(uint32_t i = 0; i < total; i += CHUNK)
+		content.append(chunk, CHUNK);
+	return content.size() == total;
+}
+
+/* returns the peak rss in KiB and the time the case took in us, or -1 on failure */
+static long bench(bench_case fn, uint32_t total, long *us)
+{
+	int fds[2];
+	if(pipe(fds) != 0) return -1;
+	pid_t pid = fork();
+	if(pid == 0)
+	{
+		auto start = std::chrono::steady_clock::now();
+		bool ok = fn(total);
+		long took = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+		ssize_t written = write(fds[1], &took, sizeof(took));
+		_exit(ok && written == sizeof(took) ? 0 : 1);
+	}
+	close(fds[1]);
+	ssize_t got = read(fds[0], us, sizeof(*us));
+	close(fds[0]);
+
+	int status;
+	struct rusage usage;
+	if(wait4(pid, &status, 0, &usage) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0 || got != sizeof(*us))
+		return -1;
+	return usage.ru_maxrss;
+}
+
+/* not a check, the numbers are from the host allocator and only show the trend */
+static void bench_content()
+{
+	for(uint32_t mib = 8; mib <= 64; mib *= 2)
+	{
+		long cus, sus;
+		long crss = bench(run_content, mib << 20, &cus);
+		long srss = bench(run_string, mib << 20, &sus);
+		CHECK(crss != -1 && srss != -1);
+		printf("content: %2lu MiB, reserved: %6ld KiB peak in %6ld us, appended: %6ld KiB peak in %6ld us\n",
+			(unsigned long) mib, crss, cus, srss, sus);
+	}
+}
+
+int main()
+{
+	test_content();
+	bench_content();
+	if(failures == 0) puts("content: all checks passed");
+	return failures != 0;
+}
+
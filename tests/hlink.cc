@@ -0,0 +1,484 @@
+/* This file is part of 3hs
+ * Copyright (C) 2021-2022 hShop developer team
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* runs hlink::create_server() on 127.0.0.1 with the stand-ins in shim/3hs/ and romfs/public
+ * as the web root, then has many clients talk to it at once */
+
+#include <hlink/hlink.hh>
+#include <hlink/http.hh>
+#include <panic.hh>
+#include <queue.hh>
+#include <log.hh>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define HTTP_PORT 8000
+/* at most this many clients are connecting at once, more may be dropped from the backlog */
+#define CLIENTS hlink::backlog
+#define LOAD_REQUESTS 64
+/* times the keep-alive test goes over romfs/public */
+#define ROUNDS 50
+/* seconds each half of it may take, a response that waits for a timeout in the server takes a second */
+#define DEADLINE 10
+
+static int failures = 0;
+
+#define CHECK(cond) \
+	if(!(cond)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); ++failures; }
+
+void _logf(const char *, const char *, size_t, LogLevel, const char *, ...) { }
+
+void panic_impl(const std::string& caller, const std::string& msg)
+{
+	fprintf(stderr, "panic in %s: %s\n", caller.c_str(), msg.c_str());
+	abort();
+}
+
+void panic_impl(const std::string& caller, Result res)
+{
+	fprintf(stderr, "panic in %s: %08lX\n", caller.c_str(), (unsigned long) res);
+	abort();
+}
+
+void panic_impl(const std::string& caller)
+{
+	fprintf(stderr, "panic in %s\n", caller.c_str());
+	abort();
+}
+
+/* what the server added to the queue */
+static std::mutex queue_lock;
+static std::vector<hsapi::hid> queued;
+
+void queue_add(const hsapi::FullTitle& meta)
+{
+	std::lock_guard<std::mutex> guard(queue_lock);
+	queued.push_back(meta.id);
+}
+
+void queue_add(const std::vector<hsapi::hid>& ids)
+{
+	std::lock_guard<std::mutex> guard(queue_lock);
+	queued.insert(queued.end(), ids.begin(), ids.end());
+}
+
+Result hsapi::title_meta(hsapi::FullTitle& ret, hsapi::hid id)
+{
+	ret.id = id;
+	ret.name = "title " + std::to_string(id);
+	return 0;
+}
+
+static bool was_queued(hsapi::hid id)
+{
+	std::lock_guard<std::mutex> guard(queue_lock);
+	for(hsapi::hid q : queued)
+		if(q == id) return true;
+	return false;
+}
+
+static std::string read_file(const std::string& path)
+{
+	std::string ret;
+	FILE *f = fopen(path.c_str(), "rb");
+	if(!f) return ret;
+	char buf[0x1000];
+	size_t r;
+	while((r = fread(buf, 1, sizeof(buf), f)) != 0)
+		ret.append(buf, r);
+	fclose(f);
+	return ret;
+}
+
+/* every file under romfs:/public that may be requested. /sleep.tpl is left
+ * out, it makes the server stop taking requests for a while */
+static void walk(const std::string& dir, std::vector<std::string>& paths)
+{
+	DIR *d = opendir(("romfs:/public" + dir).c_str());
+	if(!d) return;
+	struct dirent *ent;
+	while((ent = readdir(d)))
+	{
+		std::string name = ent->d_name;
+		if(name == "." || name == ".." || dir + name == "/sleep.tpl")
+			continue;
+		if(ent->d_type == DT_DIR) walk(dir + name + "/", paths);
+		else paths.push_back(dir + name);
+	}
+	closedir(d);
+}
+
+/* the client side */
+
+typedef struct client
+{
+	int fd = -1;
+	std::string in; /* received but not parsed yet */
+} client;
+
+typedef struct response
+{
+	int status;
+	bool keepalive;
+	std::string body;
+} response;
+
+static bool dial(client& c, u16 port)
+{
+	struct sockaddr_in addr = { };
+	struct timeval tv = { 5, 0 }; /* a server that doesn't answer fails the test instead of hanging it */
+	c.in.clear();
+	c.fd = socket(AF_INET, SOCK_STREAM, 0);
+	setsockopt(c.fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+	if(connect(c.fd, (struct sockaddr *) &addr, sizeof(addr)) == 0)
+		return true;
+	close(c.fd);
+	c.fd = -1;
+	return false;
+}
+
+static void hangup(client& c)
+{
+	if(c.fd != -1) close(c.fd);
+	c.fd = -1;
+}
+
+static bool send_all(client& c, const std::string& data)
+{
+	ssize_t w;
+	for(size_t i = 0; i < data.size(); i += w)
+		if((w = send(c.fd, data.data() + i, data.size() - i, MSG_NOSIGNAL)) <= 0)
+			return false;
+	return true;
+}
+
+/* receives until c.in has at least size bytes */
+static bool fill(client& c, size_t size)
+{
+	char buf[0x1000];
+	ssize_t r;
+	while(c.in.size() < size)
+	{
+		if((r = recv(c.fd, buf, sizeof(buf), 0)) <= 0)
+			return false;
+		c.in.append(buf, r);
+	}
+	return true;
+}
+
+/* reads one response framed by its Content-Length, what comes after it stays in c.in */
+static bool read_response(client& c, response& res)
+{
+	std::string::size_type end;
+	while((end = c.in.find("\r\n\r\n")) == std::string::npos)
+		if(!fill(c, c.in.size() + 1)) return false;
+	std::string head = c.in.substr(0, end + 2);
+	c.in.erase(0, end + 4);
+
+	if(head.compare(0, 9, "HTTP/1.1 ") != 0) return false;
+	res.status = atoi(head.c_str() + 9);
+	res.keepalive = head.find("\r\nConnection: keep-alive\r\n") != std::string::npos;
+	std::string::size_type len = head.find("\r\nContent-Length: ");
+	if(len == std::string::npos) return false;
+	size_t size = strtoul(head.c_str() + len + 18, nullptr, 10);
+
+	if(!fill(c, size)) return false;
+	res.body = c.in.substr(0, size);
+	c.in.erase(0, size);
+	return true;
+}
+
+static std::string get(const std::string& path, bool keepalive = true)
+{
+	return "GET " + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\n"
+		+ (keepalive ? "" : "Connection: close\r\n") + "\r\n";
+}
+
+/* the hLink header, with everything in network byte order */
+static std::string transaction(hlink::action action, const std::string& body)
+{
+	std::string ret(hlink::transaction_magic, hlink::transaction_magic_len);
+	u32 size = htonl(body.size());
+	ret += (char) action;
+	ret.append((const char *) &size, sizeof(size));
+	return ret + body;
+}
+
+/* returns the response code or -1 if there wasn't a complete response */
+static int read_transaction(client& c, std::string& body)
+{
+	if(!fill(c, 8) || c.in.compare(0, 3, hlink::transaction_magic) != 0)
+		return -1;
+	u32 size;
+	memcpy(&size, c.in.data() + 4, sizeof(size));
+	size = ntohl(size);
+	if(!fill(c, 8 + size)) return -1;
+	body = c.in.substr(8, size);
+	return (u8) c.in[3];
+}
+
+static int transact(hlink::action action, const std::string& body)
+{
+	client c;
+	std::string resp;
+	if(!dial(c, hlink::port)) return -1;
+	int ret = send_all(c, transaction(action, body)) ? read_transaction(c, resp) : -1;
+	hangup(c);
+	return ret;
+}
+
+static std::string be64(u64 n)
+{
+	n = __builtin_bswap64(n);
+	return std::string((const char *) &n, sizeof(n));
+}
+
+/* the tests */
+
+/* every client sends half its request head, one of them never finishes it. the ones that
+ * do all get their file even though there are more of them than handlers */
+static void test_slow_clients(const std::string& index)
+{
+	client clients[CLIENTS];
+	response res;
+
+	for(client& c : clients)
+	{
+		CHECK(dial(c, HTTP_PORT));
+		CHECK(send_all(c, "GET /index.html HTTP/1.1\r\n"));
+	}
+	for(size_t i = 1; i < CLIENTS; ++i)
+		CHECK(send_all(clients[i], "Host: 127.0.0.1\r\n\r\n"));
+	for(size_t i = 1; i < CLIENTS; ++i)
+	{
+		bool ok = read_response(clients[i], res);
+		CHECK(ok);
+		CHECK(ok && res.status == 200 && res.body == index);
+	}
+
+	/* the stalled one is still served once it's done */
+	CHECK(send_all(clients[0], "Host: 127.0.0.1\r\n\r\n"));
+	bool ok = read_response(clients[0], res);
+	CHECK(ok);
+	CHECK(ok && res.status == 200 && res.body == index);
+
+	for(client& c : clients)
+		hangup(c);
+}
+
+/* hLink transactions that come in at the same time are all accepted */
+static void test_transactions()
+{
+	client clients[CLIENTS];
+	std::string body;
+
+	for(client& c : clients)
+	{
+		CHECK(dial(c, hlink::port));
+		CHECK(send_all(c, transaction(hlink::action::nothing, "").substr(0, 2)));
+	}
+	for(client& c : clients)
+		CHECK(send_all(c, transaction(hlink::action::nothing, "").substr(2)));
+	for(client& c : clients)
+	{
+		CHECK(read_transaction(c, body) == (int) hlink::response::accept);
+		hangup(c);
+	}
+
+	CHECK(transact(hlink::action::add_queue, be64(1001) + be64(1002)) == (int) hlink::response::success);
+	CHECK(was_queued(1001) && was_queued(1002));
+	CHECK(transact(hlink::action::add_queue, "odd") == (int) hlink::response::error);
+	/* nothing is installed on the host */
+	CHECK(transact(hlink::action::launch, be64(0x0004000000123400)) == (int) hlink::response::notfound);
+
+	client c;
+	response res;
+	CHECK(dial(c, HTTP_PORT));
+	CHECK(send_all(c, get("/add-queue.tpl?id=1003")));
+	bool ok = read_response(c, res);
+	CHECK(ok && res.status == 200);
+	CHECK(was_queued(1003));
+	hangup(c);
+}
+
+/* CLIENTS clients that each make a new connection for every request, like a browser
+ * without keep-alive. every response has to be complete and right */
+static void test_load(const std::string& index)
+{
+	std::atomic<int> good { 0 };
+	std::vector<std::thread> threads;
+
+	auto start = std::chrono::steady_clock::now();
+	for(size_t i = 0; i < CLIENTS; ++i)
+		threads.emplace_back([&good, &index]() -> void {
+			response res;
+			client c;
+			for(int i = 0; i < LOAD_REQUESTS; ++i)
+			{
+				if(!dial(c, HTTP_PORT)) continue;
+				if(send_all(c, get("/index.html", false)) && read_response(c, res)
+						&& res.status == 200 && !res.keepalive && res.body == index)
+					++good;
+				hangup(c);
+			}
+		});
+	for(std::thread& th : threads)
+		th.join();
+	double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	CHECK(good == CLIENTS * LOAD_REQUESTS);
+	printf("hlink: %d requests from %d clients, a connection each: %.0f requests/sec\n",
+		(int) good, (int) CLIENTS, good / secs);
+}
+
+/* templates are rendered, everything else has to come back as it is on disk */
+static bool matches(const std::string& path, const std::string& contents, const response& res)
+{
+	if(path.size() > 4 && path.compare(path.size() - 4, 4, ".tpl") == 0)
+		return res.status == 200 || res.status == 400;
+	return res.status == 200 && res.body == contents;
+}
+
+/* the whole tree over a single connection, first a request at a time and then
+ * pipelined a round at a time, the responses have to come back in order */
+static void test_keepalive(const std::string& index)
+{
+	std::vector<std::string> paths, contents;
+	walk("/", paths);
+	CHECK(paths.size() != 0);
+	for(const std::string& path : paths)
+		contents.push_back(read_file("romfs:/public" + path));
+
+	response res;
+	client c;
+	CHECK(dial(c, HTTP_PORT));
+
+	/* a body nobody reads doesn't end up as the next request */
+	CHECK(send_all(c, "POST /index.html HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello" + get("/index.html")));
+	for(int i = 0; i < 2; ++i)
+	{
+		bool ok = read_response(c, res);
+		CHECK(ok && res.status == 200 && res.keepalive && res.body == index);
+	}
+
+	int good[2] = { 0, 0 };
+	double secs[2];
+	bool ok = true;
+	for(int pipelined = 0; pipelined < 2; ++pipelined)
+	{
+		auto start = std::chrono::steady_clock::now();
+		auto deadline = start + std::chrono::seconds(DEADLINE);
+		for(int round = 0; ok && round < ROUNDS && std::chrono::steady_clock::now() < deadline; ++round)
+		{
+			std::string reqs;
+			for(size_t i = 0; pipelined && i < paths.size(); ++i)
+				reqs += get(paths[i]);
+			if(pipelined) ok = send_all(c, reqs);
+			/* a broken connection fails the rest, don't wait for each of them */
+			for(size_t i = 0; ok && i < paths.size(); ++i)
+			{
+				ok = (pipelined || send_all(c, get(paths[i]))) && read_response(c, res) && res.keepalive;
+				if(ok && matches(paths[i], contents[i], res))
+					++good[pipelined];
+			}
+		}
+		secs[pipelined] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		CHECK(good[pipelined] == (int) (ROUNDS * paths.size()));
+	}
+	CHECK(c.in.size() == 0);
+	hangup(c);
+
+	printf("hlink: %d requests over one connection: %.0f requests/sec sequential, %.0f pipelined\n",
+		good[0] + good[1], good[0] / secs[0], good[1] / secs[1]);
+}
+
+int main()
+{
+	/* make_fd() serves from romfs:/public, so give it one in a directory of our own */
+	char dir[] = "/tmp/3hs-hlink.XXXXXX";
+	char *romfs = realpath("../romfs", nullptr);
+	if(!romfs || !mkdtemp(dir) || chdir(dir) != 0 || symlink(romfs, "romfs:") != 0)
+	{
+		perror("hlink: failed to set up romfs:");
+		return 1;
+	}
+	free(romfs);
+
+	std::atomic<bool> ready { false }, done { false }, stop { false };
+	std::mutex errors_lock;
+	std::vector<std::string> errors;
+
+	hlink::init_file_cache();
+	std::thread server([&]() -> void {
+		hlink::create_server(
+			[](const std::string&) -> bool { return true; },
+			[&errors, &errors_lock](const std::string& err) -> void {
+				std::lock_guard<std::mutex> guard(errors_lock);
+				errors.push_back(err);
+			},
+			[&ready](const std::string&) -> void { ready = true; },
+			[&stop]() -> bool { return !stop; },
+			[](const std::string&) -> void { }
+		);
+		done = true;
+	});
+	while(!ready && !done)
+		usleep(1000);
+
+	if(ready)
+	{
+		std::string index = read_file("romfs:/public/index.html");
+		CHECK(index.size() != 0);
+		test_slow_clients(index);
+		test_transactions();
+		test_load(index);
+		test_keepalive(index);
+	}
+	else CHECK(!"the server didn't start");
+
+	stop = true;
+	server.join();
+	/* launching a title that isn't there is the only error */
+	for(const std::string& err : errors)
+	{
+		if(err == "title_doesnt_exist") continue;
+		fprintf(stderr, "hlink: server error: %s\n", err.c_str());
+		++failures;
+	}
+
+	unlink("romfs:");
+	if(chdir("/") == 0) rmdir(dir);
+	if(failures == 0) puts("hlink: all checks passed");
+	return failures != 0;
+}
@@ -0,0 +1,222 @@
+/* This file is part of 3hs
+ * Copyright (C) 2021-2022 hShop developer team
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* compares the two ways hsapi can read a title listing with the vendored json library:
+ * building a document and copying it out like serialize_titles() did, and filling the
+ * titles from sax events like title_sax does. title_sax itself needs libctru, so the
+ * handler here only does the same kind of work. every case runs in its own process
+ * so ru_maxrss is the peak of that case alone */
+
+#include <3rd/json.hh>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <stdio.h>
+
+using json = nlohmann::json;
+
+#define TITLES 20000
+
+static int failures = 0;
+
+#define CHECK(cond) \
+	if(!(cond)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); ++failures; }
+
+/* the fields of hsapi::FullTitle */
+typedef struct title
+{
+	uint64_t size, dlCount, id, version, flags;
+	std::string tid, cat, subcat, name, alt, prod, seed;
+} title;
+
+static std::string make_listing(size_t count)
+{
+	std::string ret = "{\"status\":{\"code\":0,\"http_code\":200},\"value\":[";
+	char buf[512];
+	for(size_t i = 0; i < count; ++i)
+	{
+		snprintf(buf, sizeof(buf), "%s{\"size\":%zu,\"download_count\":%zu,\"id\":%zu,"
+			"\"title_id\":\"0004000000%06zX00\",\"category\":\"games\",\"subcategory\":\"europe\","
+			"\"name\":\"Some Title Name %zu\",\"flags\":0,\"alternative_name\":\"Alternative %zu\","
+			"\"product_code\":\"CTR-P-%04zu\",\"version\":%zu,\"seed\":\"\",\"is_listed\":true}",
+			i == 0 ? "" : ",", 0x1000000 + i, i * 7, i, i, i, i, i % 10000, i % 16);
+		ret += buf;
+	}
+	return ret + "]}";
+}
+
+static bool read_dom(const std::string& data, std::vector<title>& ret)
+{
+	json j = json::parse(data, nullptr, false);
+	if(j.is_discarded() || !j["value"].is_array()) return false;
+	for(json& jt : j["value"])
+	{
+		if(!jt["is_listed"].get<bool>()) continue;
+		title t;
+		t.size = jt["size"].get<uint64_t>();
+		t.dlCount = jt["download_count"].get<uint64_t>();
+		t.id = jt["id"].get<uint64_t>();
+		t.tid = jt["title_id"].get<std::string>();
+		t.cat = jt["category"].get<std::string>();
+		t.subcat = jt["subcategory"].get<std::string>();
+		t.name = jt["name"].get<std::string>();
+		t.flags = jt["flags"].get<uint64_t>();
+		t.alt = jt["alternative_name"].get<std::string>();
+		t.prod = jt["product_code"].get<std::string>();
+		t.version = jt["version"].get<uint64_t>();
+		t.seed = jt["seed"].get<std::string>();
+		ret.push_back(std::move(t));
+	}
+	return true;
+}
+
+class listing_sax
+{
+public:
+	listing_sax(std::vector<title>& list) : list(list) { }
+
+	bool null() { return true; }
+	bool boolean(bool val) { if(this->in_title() && this->curKey == "is_listed") this->listed = val; return true; }
+	bool number_integer(json::number_integer_t val) { return this->number_unsigned(val); }
+	bool number_unsigned(json::number_unsigned_t val)
+	{
+		if(!this->in_title()) return true;
+		if(this->curKey == "size") this->cur.size = val;
+		else if(this->curKey == "download_count") this->cur.dlCount = val;
+		else if(this->curKey == "id") this->cur.id = val;
+		else if(this->curKey == "flags") this->cur.flags = val;
+		else if(this->curKey == "version") this->cur.version = val;
+		return true;
+	}
+	bool number_float(json::number_float_t, const std::string&) { return true; }
+	bool binary(json::binary_t&) { return true; }
+	bool string(std::string& val)
+	{
+		if(!this->in_title()) return true;
+		if(this->curKey == "title_id") this->cur.tid.swap(val);
+		else if(this->curKey == "category") this->cur.cat = val;
+		else if(this->curKey == "subcategory") this->cur.subcat = val;
+		else if(this->curKey == "name") this->cur.name.swap(val);
+		else if(this->curKey == "alternative_name") this->cur.alt.swap(val);
+		else if(this->curKey == "product_code") this->cur.prod.swap(val);
+		else if(this->curKey == "seed") this->cur.seed.swap(val);
+		return true;
+	}
+	bool key(std::string& val) { this->curKey.swap(val); return true; }
+	bool start_object(std::size_t)
+	{
+		if(++this->depth == 3) { this->cur = title(); this->listed = false; }
+		return true;
+	}
+	bool start_array(std::size_t) { ++this->depth; return true; }
+	bool end_object()
+	{
+		if(this->depth-- == 3 && this->listed) this->list.push_back(std::move(this->cur));
+		return true;
+	}
+	bool end_array() { --this->depth; return true; }
+	bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception&) { return false; }
+
+
+private:
+	std::vector<title>& list;
+	std::string curKey;
+	title cur;
+	bool listed = false;
+	int depth = 0;
+
+	bool in_title() { return this->depth == 3; }
+
+
+};
+
+static bool read_sax(const std::string& data, std::vector<title>& ret)
+{
+	listing_sax sax(ret);
+	return json::sax_parse(data, &sax);
+}
+
+static void test_same_result()
+{
+	std::string data = make_listing(100);
+	std::vector<title> dom, sax;
+	CHECK(read_dom(data, dom));
+	CHECK(read_sax(data, sax));
+	CHECK(dom.size() == 100 && sax.size() == 100);
+	for(size_t i = 0; i < dom.size() && i < sax.size(); ++i)
+		CHECK(dom[i].id == sax[i].id && dom[i].tid == sax[i].tid && dom[i].name == sax[i].name
+			&& dom[i].prod == sax[i].prod && dom[i].version == sax[i].version && dom[i].alt == sax[i].alt);
+}
+
+typedef bool (*read_func)(const std::string&, std::vector<title>&);
+
+/* returns the peak rss in KiB and the parse time in us, or -1 on failure */
+static long bench(read_func fn, long *us, long *base)
+{
+	int fds[2];
+	if(pipe(fds) != 0) return -1;
+	pid_t pid = fork();
+	if(pid == 0)
+	{
+		std::string data = make_listing(TITLES);
+		std::vector<title> titles;
+		struct rusage usage;
+		getrusage(RUSAGE_SELF, &usage);
+		long res[2] = { 0, usage.ru_maxrss };
+		auto start = std::chrono::steady_clock::now();
+		bool ok = fn(data, titles) && titles.size() == TITLES;
+		res[0] = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+		ssize_t written = write(fds[1], res, sizeof(res));
+		_exit(ok && written == sizeof(res) ? 0 : 1);
+	}
+	close(fds[1]);
+	long res[2];
+	ssize_t got = read(fds[0], res, sizeof(res));
+	close(fds[0]);
+
+	int status;
+	struct rusage usage;
+	if(wait4(pid, &status, 0, &usage) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0 || got != sizeof(res))
+		return -1;
+	*us = res[0];
+	*base = res[1];
+	return usage.ru_maxrss;
+}
+
+/* not a check, the numbers are from the host and only show the trend */
+static void bench_listing()
+{
+	long dus, dbase, sus, sbase;
+	long drss = bench(read_dom, &dus, &dbase);
+	long srss = bench(read_sax, &sus, &sbase);
+	CHECK(drss != -1 && srss != -1);
+	printf("listing: %d titles, document: +%ld KiB peak in %ld us, sax: +%ld KiB peak in %ld us\n",
+		TITLES, drss - dbase, dus, srss - sbase, sus);
+}
+
+int main()
+{
+	test_same_result();
+	bench_listing();
+	if(failures == 0) puts("listing: all checks passed");
+	return failures != 0;
+}
+
@@ -0,0 +1,475 @@
+/* This file is part of 3hs
+ * Copyright (C) 2021-2022 hShop developer team
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* a stand-in http server on 127.0.0.1 that does or doesn't do ranges, downloaded from the
+ * way i_install_net_cia_parallel() and i_install_adopt() in source/install.cc do it */
+
+#include <ring.hh>
+#include <range.hh>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define CHUNK 0x4000
+#define TOTAL (50 * CHUNK + 321)
+/* what the look-ahead fetched of the cia */
+#define LOOKAHEAD (3 * CHUNK + 17)
+#define CONNECTIONS (RING_SIZE - 1)
+/* stand in for APPERR_NORANGE and friends */
+#define NORANGE -1
+#define FAILED -2
+
+static int failures = 0;
+
+#define CHECK(cond) \
+	if(!(cond)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); ++failures; }
+
+void _logf(const char *, const char *, size_t, LogLevel, const char *, ...) { }
+
+static u8 pattern(u32 offset)
+{
+	return (offset * 13 + (offset >> 10)) & 0xFF;
+}
+
+/* the server */
+
+typedef struct server
+{
+	int fd;
+	u16 port;
+	bool ranges;
+	std::thread th;
+	std::vector<std::thread> conns;
+	std::atomic<int> requests { 0 };
+	std::atomic<int> ranged { 0 };
+} server;
+
+static void send_all(int fd, const void *buf, size_t size)
+{
+	ssize_t w;
+	for(size_t i = 0; i < size; i += w)
+		if((w = send(fd, (const u8 *) buf + i, size - i, MSG_NOSIGNAL)) <= 0)
+			return;
+}
+
+static void serve(server& srv, int fd)
+{
+	std::string req;
+	size_t pos;
+	char c;
+	u32 from = 0, to = TOTAL - 1;
+	bool ranged = false;
+
+	while(req.find("\r\n\r\n") == std::string::npos && recv(fd, &c, 1, 0) == 1)
+		req += c;
+	++srv.requests;
+	if(srv.ranges && (pos = req.find("Range: bytes=")) != std::string::npos)
+	{
+		char *end;
+		from = strtoul(req.c_str() + pos + 13, &end, 10);
+		if(end[1] != '\r') to = strtoul(end + 1, nullptr, 10);
+		if(to >= TOTAL) to = TOTAL - 1;
+		ranged = from <= to;
+		++srv.ranged;
+	}
+	if(!ranged) from = 0, to = TOTAL - 1;
+
+	std::string head = ranged ? "HTTP/1.1 206 Partial Content\r\n" : "HTTP/1.1 200 OK\r\n";
+	if(ranged)
+		head += "Content-Range: bytes " + std::to_string(from) + "-" + std::to_string(to) + "/" + std::to_string(TOTAL) + "\r\n";
+	head += "Content-Length: " + std::to_string(to - from + 1) + "\r\nConnection: close\r\n\r\n";
+	send_all(fd, head.data(), head.size());
+
+	u8 buf[0x1000];
+	for(u32 off = from; off <= to; )
+	{
+		u32 n = to - off + 1 < sizeof(buf) ? to - off + 1 : sizeof(buf);
+		for(u32 i = 0; i < n; ++i) buf[i] = pattern(off + i);
+		send_all(fd, buf, n);
+		off += n;
+	}
+	close(fd);
+}
+
+static void server_start(server& srv, bool ranges)
+{
+	struct sockaddr_in addr = { };
+	socklen_t len = sizeof(addr);
+
+	srv.ranges = ranges;
+	srv.fd = socket(AF_INET, SOCK_STREAM, 0);
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	CHECK(bind(srv.fd, (struct sockaddr *) &addr, sizeof(addr)) == 0);
+	CHECK(listen(srv.fd, 16) == 0);
+	getsockname(srv.fd, (struct sockaddr *) &addr, &len);
+	srv.port = ntohs(addr.sin_port);
+	srv.th = std::thread([&srv]() -> void {
+		int fd;
+		while((fd = accept(srv.fd, nullptr, nullptr)) >= 0)
+			srv.conns.emplace_back(serve, std::ref(srv), fd);
+	});
+}
+
+static void server_stop(server& srv)
+{
+	shutdown(srv.fd, SHUT_RDWR);
+	close(srv.fd);
+	srv.th.join();
+	for(std::thread& th : srv.conns)
+		th.join();
+}
+
+/* the client, like i_open_request() and friends */
+
+/* returns a connection positioned at the body, or -1 */
+static int http_open(u16 port, const std::string& range, u32 *status, std::string& head)
+{
+	struct sockaddr_in addr = { };
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	char c;
+
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+	if(connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+	std::string req = "GET /cia HTTP/1.1\r\nHost: 127.0.0.1\r\n";
+	if(range.size() != 0) req += "Range: " + range + "\r\n";
+	req += "\r\n";
+	send_all(fd, req.data(), req.size());
+
+	head.clear();
+	while(head.find("\r\n\r\n") == std::string::npos && recv(fd, &c, 1, 0) == 1)
+		head += c;
+	if(sscanf(head.c_str(), "HTTP/1.1 %u", status) != 1)
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static u32 header_u32(const std::string& head, const char *name)
+{
+	size_t pos = head.find(name);
+	return pos == std::string::npos ? 0 : strtoul(head.c_str() + pos + strlen(name), nullptr, 10);
+}
+
+static bool receive(int fd, u8 *buf, u32 size)
+{
+	ssize_t r;
+	for(u32 i = 0; i < size; i += r)
+		if((r = recv(fd, buf + i, size - i, 0)) <= 0)
+			return false;
+	return true;
+}
+
+/* the parts of cia_net_data that are used */
+typedef struct download
+{
+	ring::buffer_ring ring;
+	u32 index = 0;
+	u32 received = 0;
+	u32 totalSize = 0;
+	std::vector<u8> sink;
+	std::thread writer;
+	u16 port;
+} download;
+
+static void download_start(download& dl, u16 port)
+{
+	dl.port = port;
+	dl.ring.bufsize = CHUNK;
+	for(size_t i = 0; i < RING_SIZE; ++i)
+		dl.ring.buffers[i] = (u8 *) malloc(CHUNK);
+	ring::init(dl.ring);
+	dl.writer = std::thread([&dl]() -> void {
+		ring::writer(dl, [&dl](u32 slot) -> void {
+			dl.sink.insert(dl.sink.end(), dl.ring.buffers[slot], dl.ring.buffers[slot] + dl.ring.sizes[slot]);
+			dl.index += dl.ring.sizes[slot];
+		});
+	});
+}
+
+static bool download_finish(download& dl)
+{
+	dl.ring.stop = true;
+	ring::flush(dl);
+	dl.writer.join();
+	for(size_t i = 0; i < RING_SIZE; ++i)
+		free(dl.ring.buffers[i]);
+	if(dl.sink.size() != TOTAL) return false;
+	for(u32 i = 0; i < TOTAL; ++i)
+		if(dl.sink[i] != pattern(i)) return false;
+	return true;
+}
+
+/* like i_receive_stream() */
+static int receive_stream(download& dl, int fd)
+{
+	u32 slot, size;
+	int res = 0;
+	while(dl.received != dl.totalSize)
+	{
+		slot = ring::acquire(dl.ring);
+		size = range::block(dl.totalSize, dl.received, CHUNK);
+		if(!receive(fd, dl.ring.buffers[slot], size))
+		{
+			ring::release(dl.ring, slot);
+			res = FAILED;
+			break;
+		}
+		ring::submit(dl, slot, dl.received, size);
+	}
+	close(fd);
+	return res == 0 ? ring::drain(dl) : res;
+}
+
+/* like i_range_worker_cb() */
+static void range_worker(download& dl, LightLock& lock, u32& next, int& res)
+{
+	u32 slot, offset, size, status;
+	std::string head;
+	int fd;
+	for(;;)
+	{
+		slot = ring::acquire(dl.ring);
+		LightLock_Lock(&lock);
+		size = range::block(dl.totalSize, next, CHUNK);
+		if(res != 0) size = 0;
+		offset = next;
+		next += size;
+		LightLock_Unlock(&lock);
+		if(size == 0)
+		{
+			ring::release(dl.ring, slot);
+			break;
+		}
+		bool ok = (fd = http_open(dl.port, range::header(offset, size), &status, head)) >= 0
+			&& status == 206 && receive(fd, dl.ring.buffers[slot], size);
+		if(fd >= 0) close(fd);
+		if(!ok)
+		{
+			ring::release(dl.ring, slot);
+			LightLock_Lock(&lock);
+			res = FAILED;
+			LightLock_Unlock(&lock);
+			break;
+		}
+		ring::submit(dl, slot, offset, size);
+	}
+}
+
+/* like i_install_net_cia_parallel() */
+static int download_parallel(download& dl, u32 from, bool restartable, int *adopted = nullptr)
+{
+	u32 status, slot, size = CHUNK;
+	std::string head;
+	int fd;
+
+	slot = ring::acquire(dl.ring);
+	if(from != 0 && dl.totalSize - from < size)
+		size = dl.totalSize - from;
+	if((fd = http_open(dl.port, range::header(from, size), &status, head)) < 0)
+	{
+		ring::release(dl.ring, slot);
+		return FAILED;
+	}
+
+	switch(range::classify(status, from, restartable && (adopted == nullptr || *adopted < 0)))
+	{
+	case range::reply::ranged:
+		break;
+	case range::reply::restart:
+		ring::release(dl.ring, slot);
+		close(fd);
+		ring::flush(dl);
+		dl.index = dl.received = 0;
+		dl.sink.clear();
+		return download_parallel(dl, 0, restartable);
+	case range::reply::whole:
+		ring::release(dl.ring, slot);
+		dl.totalSize = header_u32(head, "Content-Length: ");
+		return receive_stream(dl, fd);
+	case range::reply::norange:
+		ring::release(dl.ring, slot);
+		close(fd);
+		return NORANGE;
+	}
+
+	if(adopted != nullptr && *adopted >= 0)
+	{
+		close(*adopted);
+		*adopted = -1;
+	}
+	size_t pos = head.find("Content-Range: ");
+	dl.totalSize = pos == std::string::npos ? 0 : strtoul(strchr(head.c_str() + pos, '/') + 1, nullptr, 10);
+	if(size > dl.totalSize - from)
+		size = dl.totalSize - from;
+	if(!receive(fd, dl.ring.buffers[slot], size))
+	{
+		ring::release(dl.ring, slot);
+		close(fd);
+		return FAILED;
+	}
+	close(fd);
+	ring::submit(dl, slot, from, size);
+
+	std::thread workers[CONNECTIONS];
+	LightLock lock;
+	u32 next = from + size;
+	int res = 0;
+	LightLock_Init(&lock);
+	for(std::thread& th : workers)
+		th = std::thread(range_worker, std::ref(dl), std::ref(lock), std::ref(next), std::ref(res));
+	for(std::thread& th : workers)
+		th.join();
+	if(res != 0)
+	{
+		ring::flush(dl);
+		return res;
+	}
+	return ring::drain(dl);
+}
+
+/* like i_lookahead_thread_cb() followed by i_install_adopt() */
+static int download_adopted(download& dl)
+{
+	u32 status, offset, size, slot;
+	std::string head;
+	int fd, res;
+
+	if((fd = http_open(dl.port, "", &status, head)) < 0 || status != 200)
+		return FAILED;
+	dl.totalSize = header_u32(head, "Content-Length: ");
+	std::vector<u8> spool(LOOKAHEAD);
+	if(!receive(fd, spool.data(), LOOKAHEAD))
+		return FAILED;
+
+	for(offset = 0; offset != LOOKAHEAD; offset += size)
+	{
+		slot = ring::acquire(dl.ring);
+		size = LOOKAHEAD - offset < CHUNK ? LOOKAHEAD - offset : CHUNK;
+		memcpy(dl.ring.buffers[slot], spool.data() + offset, size);
+		ring::submit(dl, slot, offset, size);
+	}
+
+	res = download_parallel(dl, LOOKAHEAD, false, &fd);
+	if(fd < 0 || res != NORANGE)
+	{
+		if(fd >= 0) close(fd);
+		return res;
+	}
+	/* the server doesn't do ranges, carry on with what the look-ahead opened */
+	return receive_stream(dl, fd);
+}
+
+/* the tests */
+
+static void test_ranges()
+{
+	server srv;
+	download dl;
+	server_start(srv, true);
+	download_start(dl, srv.port);
+	CHECK(download_parallel(dl, 0, false) == 0);
+	CHECK(download_finish(dl));
+	server_stop(srv);
+	/* the first block and one for every chunk after it */
+	CHECK(srv.ranged == (TOTAL + CHUNK - 1) / CHUNK);
+}
+
+static void test_no_ranges()
+{
+	server srv;
+	download dl;
+	server_start(srv, false);
+	download_start(dl, srv.port);
+	CHECK(download_parallel(dl, 0, false) == 0);
+	CHECK(download_finish(dl));
+	server_stop(srv);
+	/* the first response already had everything */
+	CHECK(srv.requests == 1);
+}
+
+static void test_adopt_ranges()
+{
+	server srv;
+	download dl;
+	server_start(srv, true);
+	download_start(dl, srv.port);
+	CHECK(download_adopted(dl) == 0);
+	CHECK(download_finish(dl));
+	server_stop(srv);
+	CHECK(srv.ranged == (TOTAL - LOOKAHEAD + CHUNK - 1) / CHUNK);
+}
+
+/* a 200 to the range after the look-ahead used to fail the install */
+static void test_adopt_no_ranges()
+{
+	server srv;
+	download dl;
+	server_start(srv, false);
+	download_start(dl, srv.port);
+	CHECK(download_adopted(dl) == 0);
+	CHECK(download_finish(dl));
+	server_stop(srv);
+	CHECK(srv.requests == 2);
+}
+
+/* resuming a spool on a server without ranges starts over */
+static void test_resume_no_ranges()
+{
+	server srv;
+	download dl;
+	u32 slot;
+	server_start(srv, false);
+	download_start(dl, srv.port);
+	dl.totalSize = TOTAL;
+	slot = ring::acquire(dl.ring);
+	for(u32 i = 0; i < CHUNK; ++i) dl.ring.buffers[slot][i] = pattern(i);
+	ring::submit(dl, slot, 0, CHUNK);
+	ring::drain(dl);
+	CHECK(download_parallel(dl, CHUNK, false) == NORANGE);
+	CHECK(download_parallel(dl, CHUNK, true) == 0);
+	CHECK(download_finish(dl));
+	server_stop(srv);
+}
+
+int main()
+{
+	test_ranges();
+	test_no_ranges();
+	test_adopt_ranges();
+	test_adopt_no_ranges();
+	test_resume_no_ranges();
+	if(failures == 0) puts("loopback: all checks passed");
+	return failures != 0;
+}
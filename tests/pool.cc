@@ -0,0 +1,146 @@
+/* This file is part of 3hs
+ * Copyright (C) 2021-2022 hShop developer team
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* builds source/thread.cc against tests/shim/3ds.h */
+
+#include <thread.hh>
+#include <log.hh>
+
+#include <atomic>
+#include <chrono>
+#include <stdarg.h>
+#include <stdio.h>
+#include <unistd.h>
+
+static int failures = 0;
+
+#define CHECK(cond) \
+	if(!(cond)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); ++failures; }
+
+void _logf(const char *, const char *, size_t, LogLevel, const char *, ...) { }
+
+void panic_impl(const std::string& caller, const std::string& msg)
+{
+	fprintf(stderr, "panic in %s: %s\n", caller.c_str(), msg.c_str());
+	abort();
+}
+
+/* every thread is busy in a task that waits on a task it submits itself,
+ * which only finishes if join() runs the queued task */
+static void test_nested_join()
+{
+	ctr::pool pool(-2, 1);
+	int value = 0;
+	ctr::task outer = pool.run([&pool, &value]() -> void {
+		ctr::task inner = pool.run([&value]() -> void { value = 42; });
+		inner.join();
+		CHECK(inner.finished());
+	});
+	outer.join();
+	CHECK(value == 42);
+}
+
+/* a long lived task holds the only thread, the pool still makes progress for anyone who waits */
+static void test_busy_pool()
+{
+	ctr::pool pool(-2, 1);
+	volatile bool stop = false;
+	ctr::task worker = pool.run([&stop]() -> void { while(!stop) usleep(1000); });
+	std::atomic<int> count(0);
+	for(int i = 0; i < 100; ++i)
+		pool.run([&count]() -> void { ++count; }).join();
+	CHECK(count == 100);
+	stop = true;
+	worker.join();
+}
+
+static void test_many_tasks()
+{
+	ctr::pool pool(-2, 4);
+	std::atomic<int> count(0);
+	std::vector<ctr::task> tasks;
+	for(int i = 0; i < 1000; ++i)
+		tasks.push_back(pool.run([&count]() -> void { ++count; }));
+	for(ctr::task& t : tasks)
+		t.join();
+	CHECK(count == 1000);
+}
+
+/* tasks that only finish once another task signals them, without anyone joining the
+ * other task. with a pool that is full already that only works if it makes more threads */
+static void test_blocking()
+{
+	ctr::pool pool(-2, 1);
+	const int N = 4;
+	LightEvent events[N];
+	std::vector<ctr::task> tasks;
+	std::atomic<int> count(0);
+	for(int i = 0; i < N; ++i)
+		LightEvent_Init(&events[i], RESET_STICKY);
+	/* every task waits for the one submitted after it, the last one doesn't wait */
+	for(int i = 0; i < N; ++i)
+		tasks.push_back(pool.run([&events, &count, i]() -> void {
+			if(i + 1 < N) LightEvent_Wait(&events[i + 1]);
+			++count;
+			LightEvent_Signal(&events[i]);
+		}, 0, true));
+	/* only joins the first one, the others are never waited on */
+	tasks[0].join();
+	CHECK(count == N);
+	for(ctr::task& t : tasks)
+		t.join();
+}
+
+/* not a check, shows what dispatching to a warm pool costs compared to a thread per task */
+static void bench_dispatch()
+{
+	const int N = 2000;
+	ctr::pool pool(-2, 4);
+	pool.run([]() -> void { }).join();
+
+	auto start = std::chrono::steady_clock::now();
+	for(int i = 0; i < N; ++i)
+	{
+		ctr::task t = pool.run([]() -> void { });
+		while(!t.finished()) sched_yield();
+	}
+	auto pooled = std::chrono::steady_clock::now() - start;
+
+	start = std::chrono::steady_clock::now();
+	for(int i = 0; i < N; ++i)
+	{
+		Thread th = threadCreate([](void *) -> void { }, nullptr, 64 * 1024, 0x30, -2, false);
+		threadJoin(th, U64_MAX);
+		threadFree(th);
+	}
+	auto created = std::chrono::steady_clock::now() - start;
+
+	printf("pool: %d tasks, %lld us on a pool, %lld us with a thread each\n", N,
+		(long long) std::chrono::duration_cast<std::chrono::microseconds>(pooled).count(),
+		(long long) std::chrono::duration_cast<std::chrono::microseconds>(created).count());
+}
+
+int main()
+{
+	test_nested_join();
+	test_busy_pool();
+	test_many_tasks();
+	test_blocking();
+	bench_dispatch();
+	if(failures == 0) puts("pool: all checks passed");
+	return failures != 0;
+}
+
@@ -0,0 +1,79 @@
+/* This file is part of 3hs
+ * Copyright (C) 2021-2022 hShop developer team
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <range.hh>
+
+#include <stdio.h>
+
+static int failures = 0;
+
+#define CHECK(cond) \
+	if(!(cond)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); ++failures; }
+
+static void test_header()
+{
+	CHECK(range::header(0, 0) == "bytes=0-");
+	CHECK(range::header(1234, 0) == "bytes=1234-");
+	CHECK(range::header(0, 1) == "bytes=0-0");
+	CHECK(range::header(0, 0x10000) == "bytes=0-65535");
+	CHECK(range::header(100, 50) == "bytes=100-149");
+	/* the largest block a u32 offset can describe */
+	CHECK(range::header(0xFFFFFFFE, 1) == "bytes=4294967294-4294967294");
+}
+
+/* hands out blocks like the parallel workers do and checks they cover
+ * [from, total) exactly once, in order and without empty blocks */
+static void check_partition(uint32_t total, uint32_t from, uint32_t chunk)
+{
+	uint32_t next = from, blocks = 0, size;
+	while((size = range::block(total, next, chunk)) != 0)
+	{
+		CHECK(size <= chunk);
+		CHECK(next + size <= total);
+		next += size;
+		++blocks;
+	}
+	CHECK(next == (from < total ? total : from));
+	if(from < total)
+		CHECK(blocks == (total - from + chunk - 1) / chunk);
+}
+
+static void test_block()
+{
+	CHECK(range::block(100, 0, 30) == 30);
+	CHECK(range::block(100, 90, 30) == 10);
+	CHECK(range::block(100, 100, 30) == 0);
+	CHECK(range::block(100, 120, 30) == 0);
+	CHECK(range::block(0, 0, 30) == 0);
+
+	check_partition(100, 0, 30);
+	check_partition(90, 0, 30);
+	check_partition(1, 0, 0x10000);
+	check_partition(0x10000, 0, 0x10000);
+	check_partition(0x10001, 0, 0x10000);
+	check_partition(0x1234567, 0x1000, 0x20000);
+	check_partition(100, 100, 30);
+	check_partition(0xFFFFFFFF, 0xFFFF0000, 0x8000);
+}
+
+int main()
+{
+	test_header();
+	test_block();
+	if(failures == 0) puts("range: all checks passed");
+	return failures != 0;
+}
+
@@ -0,0 +1,280 @@
+/* This file is part of 3hs
+ * Copyright (C) 2021-2022 hShop developer team
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* drives include/ring.hh the way source/install.cc does, with a socket
+ * standing in for the http connection and a vector for the AM handle */
+
+#include <ring.hh>
+#include <range.hh>
+
+#include <sys/socket.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <thread>
+#include <vector>
+
+#define BUFSIZE 0x1000
+/* stands in for APPERR_CANCELLED */
+#define CANCELLED -1
+
+static int failures = 0;
+
+#define CHECK(cond) \
+	if(!(cond)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); ++failures; }
+
+void _logf(const char *, const char *, size_t, LogLevel, const char *, ...) { }
+
+/* the parts of cia_net_data the ring needs */
+typedef struct pipeline
+{
+	ring::buffer_ring ring;
+	u32 index = 0;
+	u32 received = 0;
+	/* stands in for ITC::exit */
+	volatile bool exit = false;
+	std::vector<u8> sink;
+	std::thread writer;
+} pipeline;
+
+static u8 pattern(u32 offset)
+{
+	return (offset * 31 + (offset >> 12) * 7) & 0xFF;
+}
+
+/* like i_install_write_slot() */
+static void sink_write(pipeline& p, u32 slot)
+{
+	if(p.exit)
+	{
+		p.ring.res = CANCELLED;
+		return;
+	}
+	p.sink.insert(p.sink.end(), p.ring.buffers[slot], p.ring.buffers[slot] + p.ring.sizes[slot]);
+	p.index += p.ring.sizes[slot];
+}
+
+static void pipeline_start(pipeline& p)
+{
+	p.ring.bufsize = BUFSIZE;
+	for(size_t i = 0; i < RING_SIZE; ++i)
+		p.ring.buffers[i] = (u8 *) malloc(BUFSIZE);
+	ring::init(p.ring);
+	p.writer = std::thread([&p]() -> void {
+		ring::writer(p, [&p](u32 slot) -> void { sink_write(p, slot); });
+	});
+}
+
+/* like the end of i_install_resume_loop() */
+static void pipeline_stop(pipeline& p)
+{
+	p.ring.stop = true;
+	ring::flush(p);
+	p.writer.join();
+	/* every buffer made it back, even the ones that were discarded */
+	CHECK(p.ring.nfree == RING_SIZE);
+	for(size_t i = 0; i < RING_SIZE; ++i)
+		free(p.ring.buffers[i]);
+}
+
+static bool sink_matches(pipeline& p, u32 size)
+{
+	if(p.sink.size() != size) return false;
+	for(u32 i = 0; i < size; ++i)
+		if(p.sink[i] != pattern(i)) return false;
+	return true;
+}
+
+/* writes size bytes of the pattern to fd in sizes that don't line up with the buffers */
+static void feed(int fd, u32 size)
+{
+	u8 buf[777];
+	u32 off = 0, n, i;
+	ssize_t w;
+	while(off != size)
+	{
+		n = size - off < sizeof(buf) ? size - off : sizeof(buf);
+		for(i = 0; i < n; ++i) buf[i] = pattern(off + i);
+		for(i = 0; i < n; i += w)
+			if((w = send(fd, buf + i, n - i, MSG_NOSIGNAL)) <= 0)
+				goto out;
+		off += n;
+	}
+out:
+	close(fd);
+}
+
+/* like httpcReceiveDataTimeout(), fills all of buf unless the other end is gone */
+static bool receive(int fd, u8 *buf, u32 size)
+{
+	ssize_t r;
+	for(u32 i = 0; i < size; i += r)
+		if((r = read(fd, buf + i, size - i)) <= 0)
+			return false;
+	return true;
+}
+
+/* one connection like i_receive_stream(), many more buffers than there are slots */
+static void test_stream()
+{
+	const u32 total = 37 * BUFSIZE + 123;
+	pipeline p;
+	int fds[2];
+	u32 slot, size;
+
+	CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+	std::thread feeder(feed, fds[1], total);
+	pipeline_start(p);
+
+	while(p.received != total)
+	{
+		slot = ring::acquire(p.ring);
+		size = range::block(total, p.received, BUFSIZE);
+		if(!receive(fds[0], p.ring.buffers[slot], size))
+		{
+			ring::release(p.ring, slot);
+			break;
+		}
+		ring::submit(p, slot, p.received, size);
+	}
+	CHECK(R_SUCCEEDED(ring::drain(p)));
+	CHECK(p.index == total);
+
+	feeder.join();
+	close(fds[0]);
+	pipeline_stop(p);
+	CHECK(sink_matches(p, total));
+}
+
+/* several connections handing out blocks like i_range_worker_cb(), so buffers
+ * are submitted out of order and the writer thread has to hold on to them */
+static void test_parallel()
+{
+	const u32 total = 61 * BUFSIZE + 5;
+	std::thread workers[RING_SIZE - 1];
+	LightLock lock;
+	u32 next = 0;
+	pipeline p;
+
+	LightLock_Init(&lock);
+	pipeline_start(p);
+	for(std::thread& th : workers)
+		th = std::thread([&p, &lock, &next, total]() -> void {
+			u32 slot, offset, size;
+			for(;;)
+			{
+				/* a block is only claimed once there's room for it */
+				slot = ring::acquire(p.ring);
+				LightLock_Lock(&lock);
+				offset = next;
+				size = range::block(total, next, BUFSIZE);
+				next += size;
+				LightLock_Unlock(&lock);
+				if(size == 0)
+				{
+					ring::release(p.ring, slot);
+					break;
+				}
+				/* make the blocks finish in a different order than they were claimed in */
+				usleep(rand() % 300);
+				for(u32 i = 0; i < size; ++i)
+					p.ring.buffers[slot][i] = pattern(offset + i);
+				ring::submit(p, slot, offset, size);
+			}
+		});
+	for(std::thread& th : workers)
+		th.join();
+
+	CHECK(R_SUCCEEDED(ring::drain(p)));
+	CHECK(p.index == total);
+	pipeline_stop(p);
+	CHECK(sink_matches(p, total));
+}
+
+/* buffers that can't become contiguous are dropped on a flush */
+static void test_flush()
+{
+	pipeline p;
+	u32 slot;
+
+	pipeline_start(p);
+	slot = ring::acquire(p.ring);
+	ring::submit(p, slot, BUFSIZE, BUFSIZE);
+	slot = ring::acquire(p.ring);
+	ring::submit(p, slot, 2 * BUFSIZE, BUFSIZE);
+	ring::flush(p);
+	CHECK(p.index == 0);
+	CHECK(p.received == 0);
+	CHECK(R_SUCCEEDED(p.ring.res));
+	CHECK(p.ring.nfree == RING_SIZE);
+	pipeline_stop(p);
+	CHECK(p.sink.size() == 0);
+}
+
+/* ITC::exit while the connection is still busy, nothing is written after it */
+static void test_exit()
+{
+	const u32 total = 100 * BUFSIZE;
+	pipeline p;
+	int fds[2];
+	u32 slot, size, written = 0;
+
+	CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+	std::thread feeder(feed, fds[1], total);
+	pipeline_start(p);
+
+	while(p.received != total)
+	{
+		slot = ring::acquire(p.ring);
+		size = range::block(total, p.received, BUFSIZE);
+		if(p.received >= 10 * BUFSIZE)
+		{
+			/* the ui thread cancelled, like CHK_EXIT() */
+			ring::drain(p);
+			written = p.index;
+			p.exit = true;
+			/* this one may not make it to the sink anymore */
+			receive(fds[0], p.ring.buffers[slot], size);
+			ring::submit(p, slot, p.received, size);
+			break;
+		}
+		if(!receive(fds[0], p.ring.buffers[slot], size))
+		{
+			ring::release(p.ring, slot);
+			break;
+		}
+		ring::submit(p, slot, p.received, size);
+	}
+
+	/* the writer thread still stops and gives every buffer back */
+	close(fds[0]);
+	feeder.join();
+	pipeline_stop(p);
+	CHECK(p.ring.res == CANCELLED);
+	CHECK(p.index == written);
+	CHECK(sink_matches(p, written));
+}
+
+int main()
+{
+	test_stream();
+	test_parallel();
+	test_flush();
+	test_exit();
+	if(failures == 0) puts("ring: all checks passed");
+	return failures != 0;
+}
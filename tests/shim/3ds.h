@@ -0,0 +1,199 @@
+/* This file is part of 3hs
+ * Copyright (C) 2021-2022 hShop developer team
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* the subset of libctru source/thread.cc, include/ring.hh and source/hlink/ use, on top of pthreads
+ * and bsd sockets so they can be tested on the host. only for tests/, never for the 3ds build */
+
+#ifndef inc_shim_3ds_h
+#define inc_shim_3ds_h
+
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+typedef s32 Result;
+typedef u32 Handle;
+
+#define U64_MAX UINT64_MAX
+#define R_FAILED(res) ((Result) (res) < 0)
+#define R_SUCCEEDED(res) ((Result) (res) >= 0)
+#define CUR_THREAD_HANDLE 0xFFFF8000
+
+typedef enum { RESET_ONESHOT = 0, RESET_STICKY = 1 } ResetType;
+
+typedef pthread_mutex_t LightLock;
+static inline void LightLock_Init(LightLock *lock) { pthread_mutex_init(lock, NULL); }
+static inline void LightLock_Lock(LightLock *lock) { pthread_mutex_lock(lock); }
+static inline void LightLock_Unlock(LightLock *lock) { pthread_mutex_unlock(lock); }
+
+typedef struct
+{
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int state;
+	ResetType type;
+} LightEvent;
+
+static inline void LightEvent_Init(LightEvent *ev, ResetType type)
+{
+	pthread_mutex_init(&ev->lock, NULL);
+	pthread_cond_init(&ev->cond, NULL);
+	ev->state = 0;
+	ev->type = type;
+}
+
+static inline void LightEvent_Signal(LightEvent *ev)
+{
+	pthread_mutex_lock(&ev->lock);
+	ev->state = 1;
+	pthread_cond_broadcast(&ev->cond);
+	pthread_mutex_unlock(&ev->lock);
+}
+
+static inline void LightEvent_Clear(LightEvent *ev)
+{
+	pthread_mutex_lock(&ev->lock);
+	ev->state = 0;
+	pthread_mutex_unlock(&ev->lock);
+}
+
+static inline void LightEvent_Wait(LightEvent *ev)
+{
+	pthread_mutex_lock(&ev->lock);
+	while(!ev->state)
+		pthread_cond_wait(&ev->cond, &ev->lock);
+	if(ev->type == RESET_ONESHOT) ev->state = 0;
+	pthread_mutex_unlock(&ev->lock);
+}
+
+typedef struct
+{
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	s32 count;
+} LightSemaphore;
+
+static inline void LightSemaphore_Init(LightSemaphore *sem, s16 initial, s16 max)
+{
+	(void) max;
+	pthread_mutex_init(&sem->lock, NULL);
+	pthread_cond_init(&sem->cond, NULL);
+	sem->count = initial;
+}
+
+static inline void LightSemaphore_Acquire(LightSemaphore *sem, s32 count)
+{
+	pthread_mutex_lock(&sem->lock);
+	while(sem->count < count)
+		pthread_cond_wait(&sem->cond, &sem->lock);
+	sem->count -= count;
+	pthread_mutex_unlock(&sem->lock);
+}
+
+static inline void LightSemaphore_Release(LightSemaphore *sem, s32 count)
+{
+	pthread_mutex_lock(&sem->lock);
+	sem->count += count;
+	pthread_cond_broadcast(&sem->cond);
+	pthread_mutex_unlock(&sem->lock);
+}
+
+typedef struct shim_thread *Thread;
+typedef void (*ThreadFunc)(void *);
+
+struct shim_thread
+{
+	pthread_t handle;
+	ThreadFunc entry;
+	void *arg;
+};
+
+static inline void *shim_thread_entry(void *arg)
+{
+	Thread th = (Thread) arg;
+	th->entry(th->arg);
+	return NULL;
+}
+
+static inline Thread threadCreate(ThreadFunc entry, void *arg, size_t stack_size, int prio, int core_id, bool detached)
+{
+	(void) stack_size; (void) prio; (void) core_id; (void) detached;
+	Thread th = (Thread) malloc(sizeof(struct shim_thread));
+	th->entry = entry;
+	th->arg = arg;
+	if(pthread_create(&th->handle, NULL, shim_thread_entry, th) != 0)
+	{
+		free(th);
+		return NULL;
+	}
+	return th;
+}
+
+static inline Result threadJoin(Thread th, u64 timeout)
+{
+	(void) timeout;
+	pthread_join(th->handle, NULL);
+	return 0;
+}
+
+static inline void threadFree(Thread th) { free(th); }
+
+static inline Result svcGetThreadPriority(s32 *prio, Handle th) { (void) th; *prio = 0x30; return 0; }
+static inline Result svcSetThreadPriority(Handle th, s32 prio) { (void) th; (void) prio; return 0; }
+static inline Result APT_CheckNew3DS(bool *isNew) { *isNew = false; return 0; }
+
+static inline u64 osGetTime()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (u64) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static inline void svcSleepThread(s64 ns)
+{
+	struct timespec ts = { (time_t) (ns / 1000000000LL), (long) (ns % 1000000000LL) };
+	nanosleep(&ts, NULL);
+}
+
+typedef enum
+{
+	MEDIATYPE_NAND      = 0,
+	MEDIATYPE_SD        = 1,
+	MEDIATYPE_GAME_CARD = 2,
+} FS_MediaType;
+
+/* there's nothing to jump to, the server only asks for it once a title exists */
+static inline Result APT_PrepareToDoApplicationJump(u8 flags, u64 programID, u8 mediatype)
+{ (void) flags; (void) programID; (void) mediatype; return 0; }
+static inline Result APT_DoApplicationJump(const void *param, size_t paramSize, const void *hmac)
+{ (void) param; (void) paramSize; (void) hmac; return 0; }
+
+/* the soc service returns the address of the console, on the host the servers listen on loopback.
+ * <unistd.h> is included above so its declaration isn't replaced */
+#define gethostid() ((long) htonl(INADDR_LOOPBACK))
+
+#endif
+
@@ -0,0 +1,61 @@
+/* This file is part of 3hs
+ * Copyright (C) 2021-2022 hShop developer team
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* stands in for include/ctr.hh when tests/ builds source/hlink/, no titles are installed on the host */
+
+#ifndef inc_ctr_hh
+#define inc_ctr_hh
+
+#include <3ds.h>
+
+#include <string>
+
+#include <stdio.h>
+
+
+namespace ctr
+{
+	typedef struct TitleSMDHTitle
+	{
+		u16 descShort[0x40];
+		u16 descLong[0x80];
+		u16 publisher[0x40];
+	} TitleSMDHTitle;
+
+	typedef struct TitleSMDH
+	{
+		TitleSMDHTitle titles[0x10];
+	} TitleSMDH;
+
+	static inline std::string tid_to_str(u64 tid)
+	{
+		char buf[17];
+		snprintf(buf, sizeof(buf), "%016llX", (unsigned long long) tid);
+		return buf;
+	}
+
+	static inline FS_MediaType mediatype_of(u64 tid) { (void) tid; return MEDIATYPE_SD; }
+	static inline bool title_exists(u64 tid, FS_MediaType media = MEDIATYPE_SD) { (void) tid; (void) media; return false; }
+
+	namespace smdh
+	{
+		static inline TitleSMDHTitle *get_native_title(TitleSMDH *smdh) { return &smdh->titles[1]; }
+		static inline std::string u16conv(u16 *str, size_t size) { (void) str; (void) size; return ""; }
+		static inline TitleSMDH *get(u64 tid) { (void) tid; return nullptr; }
+	}
+}
+
+#endif
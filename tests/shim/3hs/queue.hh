@@ -0,0 +1,29 @@
+/* This file is part of 3hs
+ * Copyright (C) 2021-2022 hShop developer team
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* stands in for include/queue.hh when tests/ builds source/hlink/, the test defines these */
+
+#ifndef inc_queue_hh
+#define inc_queue_hh
+
+#include "hsapi.hh"
+
+#include <vector>
+
+void queue_add(const hsapi::FullTitle& meta);
+void queue_add(const std::vector<hsapi::hid>& ids);
+
+#endif
@@ -0,0 +1,48 @@
+/* This file is part of 3hs
+ * Copyright (C) 2021-2022 hShop developer team
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* stands in for include/util.hh when tests/ builds source/hlink/, the real one needs the ui */
+
+#ifndef inc_util_hh
+#define inc_util_hh
+
+#include <string>
+#include <vector>
+
+#include <ctype.h>
+
+static inline void lower(std::string& s)
+{
+	for(size_t i = 0; i < s.size(); ++i)
+		s[i] = tolower(s[i]);
+}
+
+static inline void trim(std::string& str, const std::string& whitespace)
+{
+	const size_t str_begin = str.find_first_not_of(whitespace);
+	if(str_begin == std::string::npos) { str = ""; return; }
+	str = str.substr(str_begin, str.find_last_not_of(whitespace) - str_begin + 1);
+}
+
+static inline void join(std::string& ret, const std::vector<std::string>& tokens, const std::string& sep)
+{
+	if(tokens.size() == 0) { ret = ""; return; }
+	ret = tokens[0];
+	for(size_t i = 1; i < tokens.size(); ++i)
+		ret += sep + tokens[i];
+}
+
+#endif